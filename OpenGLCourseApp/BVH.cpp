@@ -0,0 +1,317 @@
+#include "pch.h"
+#include "BVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <thread>
+
+static const int SAH_BINS = 12;
+static const GLuint MAX_LEAF_PRIMITIVES = 4;
+
+// subtrees at least this large and this shallow get their own thread
+static const GLuint MIN_PARALLEL_PRIMITIVES = 4096;
+static const int MAX_PARALLEL_DEPTH = 3;
+
+static GLfloat SurfaceArea(glm::vec3 minCorner, glm::vec3 maxCorner)
+{
+	glm::vec3 extent = maxCorner - minCorner;
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+BVH::BVH()
+{
+	nodeCount = 0;
+}
+
+BVH::BVH(const BVH& other) : nodes(other.nodes), primitives(other.primitives)
+{
+	nodeCount = other.nodeCount.load();
+}
+
+BVH& BVH::operator=(const BVH& other)
+{
+	nodes = other.nodes;
+	primitives = other.primitives;
+	nodeCount = other.nodeCount.load();
+	return *this;
+}
+
+void BVH::Build(const std::vector<BoundingBox>& boxes)
+{
+	Clear();
+
+	GLuint primitiveCount = boxes.size();
+	if (primitiveCount == 0)
+	{
+		return;
+	}
+
+	primitives.resize(primitiveCount);
+	std::vector<glm::vec3> centroids(primitiveCount);
+	for (GLuint i = 0; i < primitiveCount; i++)
+	{
+		primitives[i] = i;
+		centroids[i] = boxes[i].GetCentre();
+	}
+
+	// a binary tree with single primitive leaves has at most 2n - 1 nodes
+	nodes.resize(primitiveCount * 2);
+	nodeCount = 1;
+
+	Node& root = nodes[0];
+	root.leftFirst = 0;
+	root.count = primitiveCount;
+	UpdateBounds(root, boxes);
+
+	Subdivide(0, boxes, centroids, 0);
+
+	nodes.resize(nodeCount);
+}
+
+void BVH::UpdateBounds(Node& node, const std::vector<BoundingBox>& boxes)
+{
+	node.minCorner = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	node.maxCorner = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	for (GLuint i = 0; i < node.count; i++)
+	{
+		const BoundingBox& box = boxes[primitives[node.leftFirst + i]];
+		node.minCorner = glm::min(node.minCorner, box.GetMin());
+		node.maxCorner = glm::max(node.maxCorner, box.GetMax());
+	}
+}
+
+void BVH::Subdivide(GLuint nodeIndex, const std::vector<BoundingBox>& boxes, const std::vector<glm::vec3>& centroids, int depth)
+{
+	Node& node = nodes[nodeIndex];
+	if (node.count <= MAX_LEAF_PRIMITIVES || depth >= MAX_DEPTH)
+	{
+		return;
+	}
+
+	GLuint first = node.leftFirst, count = node.count;
+
+	// split on the centroid bounds, not the node bounds, so bins are never empty by construction
+	glm::vec3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX), centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (GLuint i = 0; i < count; i++)
+	{
+		centroidMin = glm::min(centroidMin, centroids[primitives[first + i]]);
+		centroidMax = glm::max(centroidMax, centroids[primitives[first + i]]);
+	}
+
+	int bestAxis = -1;
+	GLfloat bestPosition = 0.0f;
+	GLfloat bestCost = SurfaceArea(node.minCorner, node.maxCorner) * count;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		GLfloat extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f)
+		{
+			continue;
+		}
+
+		glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+		GLuint binCount[SAH_BINS];
+		for (int b = 0; b < SAH_BINS; b++)
+		{
+			binMin[b] = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+			binMax[b] = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			binCount[b] = 0;
+		}
+
+		GLfloat scale = SAH_BINS / extent;
+		for (GLuint i = 0; i < count; i++)
+		{
+			GLuint primitive = primitives[first + i];
+			int b = std::min(SAH_BINS - 1, (int)((centroids[primitive][axis] - centroidMin[axis]) * scale));
+			binMin[b] = glm::min(binMin[b], boxes[primitive].GetMin());
+			binMax[b] = glm::max(binMax[b], boxes[primitive].GetMax());
+			binCount[b]++;
+		}
+
+		// sweep from both ends to cost every bin boundary in linear time
+		GLfloat leftArea[SAH_BINS - 1], rightArea[SAH_BINS - 1];
+		GLuint leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+		glm::vec3 leftMin(FLT_MAX, FLT_MAX, FLT_MAX), leftMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		glm::vec3 rightMin(FLT_MAX, FLT_MAX, FLT_MAX), rightMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		GLuint leftSum = 0, rightSum = 0;
+
+		for (int b = 0; b < SAH_BINS - 1; b++)
+		{
+			leftSum += binCount[b];
+			leftCount[b] = leftSum;
+			leftMin = glm::min(leftMin, binMin[b]);
+			leftMax = glm::max(leftMax, binMax[b]);
+			leftArea[b] = leftSum ? SurfaceArea(leftMin, leftMax) : 0.0f;
+
+			int r = SAH_BINS - 1 - b;
+			rightSum += binCount[r];
+			rightCount[r - 1] = rightSum;
+			rightMin = glm::min(rightMin, binMin[r]);
+			rightMax = glm::max(rightMax, binMax[r]);
+			rightArea[r - 1] = rightSum ? SurfaceArea(rightMin, rightMax) : 0.0f;
+		}
+
+		for (int b = 0; b < SAH_BINS - 1; b++)
+		{
+			GLfloat cost = leftArea[b] * leftCount[b] + rightArea[b] * rightCount[b];
+			if (leftCount[b] > 0 && rightCount[b] > 0 && cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestPosition = centroidMin[axis] + extent * (b + 1) / SAH_BINS;
+			}
+		}
+	}
+
+	if (bestAxis < 0)
+	{
+		// nothing beats a leaf
+		return;
+	}
+
+	GLuint* begin = &primitives[first];
+	GLuint* middle = std::partition(begin, begin + count, [&](GLuint primitive) {
+		return centroids[primitive][bestAxis] < bestPosition;
+	});
+	GLuint leftPrimitives = middle - begin;
+	if (leftPrimitives == 0 || leftPrimitives == count)
+	{
+		return;
+	}
+
+	GLuint leftIndex = nodeCount.fetch_add(2);
+
+	Node& left = nodes[leftIndex];
+	left.leftFirst = first;
+	left.count = leftPrimitives;
+	UpdateBounds(left, boxes);
+
+	Node& right = nodes[leftIndex + 1];
+	right.leftFirst = first + leftPrimitives;
+	right.count = count - leftPrimitives;
+	UpdateBounds(right, boxes);
+
+	node.leftFirst = leftIndex;
+	node.count = 0;
+
+	// the two halves touch disjoint primitive ranges and nodes, so they can be built concurrently
+	if (depth < MAX_PARALLEL_DEPTH && count >= MIN_PARALLEL_PRIMITIVES)
+	{
+		std::thread leftBuild(&BVH::Subdivide, this, leftIndex, std::cref(boxes), std::cref(centroids), depth + 1);
+		Subdivide(leftIndex + 1, boxes, centroids, depth + 1);
+		leftBuild.join();
+	}
+	else {
+		Subdivide(leftIndex, boxes, centroids, depth + 1);
+		Subdivide(leftIndex + 1, boxes, centroids, depth + 1);
+	}
+}
+
+void BVH::Refit(const std::vector<BoundingBox>& boxes)
+{
+	// children are always allocated after their parent, so a reverse sweep is bottom up
+	for (GLuint i = nodeCount; i-- > 0;)
+	{
+		Node& node = nodes[i];
+		if (node.count > 0)
+		{
+			UpdateBounds(node, boxes);
+		}
+		else {
+			const Node& left = nodes[node.leftFirst];
+			const Node& right = nodes[node.leftFirst + 1];
+			node.minCorner = glm::min(left.minCorner, right.minCorner);
+			node.maxCorner = glm::max(left.maxCorner, right.maxCorner);
+		}
+	}
+}
+
+void BVH::QueryFrustum(const Frustum& frustum, std::vector<GLuint>& results) const
+{
+	results.clear();
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	GLuint stack[MAX_DEPTH + 1];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+		if (!frustum.TestBox(BoundingBox(node.minCorner, node.maxCorner)))
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			results.insert(results.end(), primitives.begin() + node.leftFirst, primitives.begin() + node.leftFirst + node.count);
+		}
+		else {
+			stack[stackSize++] = node.leftFirst;
+			stack[stackSize++] = node.leftFirst + 1;
+		}
+	}
+}
+
+void BVH::QuerySphere(glm::vec3 centre, GLfloat radius, std::vector<GLuint>& results) const
+{
+	results.clear();
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	GLuint stack[MAX_DEPTH + 1];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+
+		glm::vec3 closest = glm::min(glm::max(centre, node.minCorner), node.maxCorner);
+		glm::vec3 offset = closest - centre;
+		if (glm::dot(offset, offset) > radius * radius)
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			results.insert(results.end(), primitives.begin() + node.leftFirst, primitives.begin() + node.leftFirst + node.count);
+		}
+		else {
+			stack[stackSize++] = node.leftFirst;
+			stack[stackSize++] = node.leftFirst + 1;
+		}
+	}
+}
+
+bool BVH::RayBox(const Node& node, glm::vec3 origin, glm::vec3 inverseDirection, GLfloat maxDistance, GLfloat& entry)
+{
+	glm::vec3 t0 = (node.minCorner - origin) * inverseDirection;
+	glm::vec3 t1 = (node.maxCorner - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+
+	entry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+	GLfloat exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+
+	return entry <= exit;
+}
+
+void BVH::Clear()
+{
+	nodes.clear();
+	primitives.clear();
+	nodeCount = 0;
+}
+
+BVH::~BVH()
+{
+}
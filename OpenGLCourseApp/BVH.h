@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "BoundingBox.h"
+#include "Frustum.h"
+
+// Bounding volume hierarchy over arbitrary primitives given as boxes: triangles of a model or
+// objects of the scene. Built top down with binned SAH, the upper levels in parallel. Nodes are
+// 32 bytes, children are allocated in pairs, so a node only needs the index of its left child.
+// Refit keeps the topology and recomputes the boxes, for primitives that moved a little.
+class BVH
+{
+public:
+	BVH();
+	BVH(const BVH& other);
+	BVH& operator=(const BVH& other);
+
+	void Build(const std::vector<BoundingBox>& boxes);
+	void Refit(const std::vector<BoundingBox>& boxes);
+	void Clear();
+
+	// primitives whose box is inside or touching the frustum / sphere
+	void QueryFrustum(const Frustum& frustum, std::vector<GLuint>& results) const;
+	void QuerySphere(glm::vec3 centre, GLfloat radius, std::vector<GLuint>& results) const;
+
+	// Visits primitives whose box the ray enters before maxDistance, nearest nodes first.
+	// hit(primitive, maxDistance) tests the primitive itself and may shorten maxDistance.
+	template <typename Hit>
+	void Raycast(glm::vec3 origin, glm::vec3 direction, GLfloat maxDistance, Hit hit) const;
+
+	bool IsEmpty() const { return nodes.empty(); }
+	GLuint GetNodeCount() const { return nodeCount; }
+
+	~BVH();
+
+private:
+	struct Node {
+		glm::vec3 minCorner;
+		GLuint leftFirst;   // left child for interior nodes, first primitive for leaves
+		glm::vec3 maxCorner;
+		GLuint count;       // primitives in a leaf, 0 for interior nodes
+	};
+
+	// Nodes this deep become leaves however many primitives they hold. A depth-first walk keeps
+	// at most one pending sibling per level, so MAX_DEPTH + 1 entries always hold its stack.
+	static const int MAX_DEPTH = 48;
+
+	void Subdivide(GLuint nodeIndex, const std::vector<BoundingBox>& boxes, const std::vector<glm::vec3>& centroids, int depth);
+	void UpdateBounds(Node& node, const std::vector<BoundingBox>& boxes);
+
+	static bool RayBox(const Node& node, glm::vec3 origin, glm::vec3 inverseDirection, GLfloat maxDistance, GLfloat& entry);
+
+	std::vector<Node> nodes;
+	std::vector<GLuint> primitives;
+	// atomic only for the parallel build
+	std::atomic<GLuint> nodeCount;
+};
+
+template <typename Hit>
+void BVH::Raycast(glm::vec3 origin, glm::vec3 direction, GLfloat maxDistance, Hit hit) const
+{
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+
+	GLuint stack[MAX_DEPTH + 1];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+
+		GLfloat entry;
+		if (!RayBox(node, origin, inverseDirection, maxDistance, entry))
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			for (GLuint i = 0; i < node.count; i++)
+			{
+				hit(primitives[node.leftFirst + i], maxDistance);
+			}
+			continue;
+		}
+
+		// push the farther child first so the nearer one is visited next
+		GLfloat leftEntry, rightEntry;
+		bool left = RayBox(nodes[node.leftFirst], origin, inverseDirection, maxDistance, leftEntry);
+		bool right = RayBox(nodes[node.leftFirst + 1], origin, inverseDirection, maxDistance, rightEntry);
+
+		if (left && right)
+		{
+			bool leftFirst = leftEntry <= rightEntry;
+			stack[stackSize++] = node.leftFirst + (leftFirst ? 1 : 0);
+			stack[stackSize++] = node.leftFirst + (leftFirst ? 0 : 1);
+		}
+		else if (left) {
+			stack[stackSize++] = node.leftFirst;
+		}
+		else if (right) {
+			stack[stackSize++] = node.leftFirst + 1;
+		}
+	}
+}
+
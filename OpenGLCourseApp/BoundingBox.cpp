@@ -0,0 +1,77 @@
+#include "pch.h"
+#include "BoundingBox.h"
+
+#include <cfloat>
+
+BoundingBox::BoundingBox()
+{
+	minCorner = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	maxCorner = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+BoundingBox::BoundingBox(glm::vec3 minCorner, glm::vec3 maxCorner)
+{
+	this->minCorner = minCorner;
+	this->maxCorner = maxCorner;
+}
+
+void BoundingBox::Expand(glm::vec3 point)
+{
+	minCorner = glm::min(minCorner, point);
+	maxCorner = glm::max(maxCorner, point);
+}
+
+void BoundingBox::Expand(const BoundingBox& box)
+{
+	if (box.IsEmpty())
+	{
+		return;
+	}
+
+	minCorner = glm::min(minCorner, box.minCorner);
+	maxCorner = glm::max(maxCorner, box.maxCorner);
+}
+
+bool BoundingBox::IsEmpty() const
+{
+	return minCorner.x > maxCorner.x || minCorner.y > maxCorner.y || minCorner.z > maxCorner.z;
+}
+
+BoundingBox BoundingBox::Transform(const glm::mat4& transform) const
+{
+	if (IsEmpty())
+	{
+		return *this;
+	}
+
+	// transform the centre, then grow the extents by the absolute value of the rotation/scale part
+	glm::vec3 centre = glm::vec3(transform * glm::vec4(GetCentre(), 1.0f));
+	glm::vec3 extents = GetExtents();
+
+	glm::vec3 newExtents(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < 3; i++)
+	{
+		newExtents += glm::abs(glm::vec3(transform[i])) * extents[i];
+	}
+
+	return BoundingBox(centre - newExtents, centre + newExtents);
+}
+
+glm::vec3 BoundingBox::GetCentre() const
+{
+	return (minCorner + maxCorner) * 0.5f;
+}
+
+glm::vec3 BoundingBox::GetExtents() const
+{
+	return (maxCorner - minCorner) * 0.5f;
+}
+
+GLfloat BoundingBox::GetRadius() const
+{
+	return glm::length(GetExtents());
+}
+
+BoundingBox::~BoundingBox()
+{
+}
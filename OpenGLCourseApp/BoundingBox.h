@@ -0,0 +1,32 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Axis-aligned box used for culling. A default constructed box is empty and grows with Expand.
+class BoundingBox
+{
+public:
+	BoundingBox();
+	BoundingBox(glm::vec3 minCorner, glm::vec3 maxCorner);
+
+	void Expand(glm::vec3 point);
+	void Expand(const BoundingBox& box);
+
+	bool IsEmpty() const;
+
+	BoundingBox Transform(const glm::mat4& transform) const;
+
+	glm::vec3 GetMin() const { return minCorner; }
+	glm::vec3 GetMax() const { return maxCorner; }
+	glm::vec3 GetCentre() const;
+	glm::vec3 GetExtents() const;
+	GLfloat GetRadius() const;
+
+	~BoundingBox();
+
+private:
+	glm::vec3 minCorner;
+	glm::vec3 maxCorner;
+};
+
@@ -0,0 +1,230 @@
+#include "pch.h"
+#include "ClusterSet.h"
+
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+
+static const unsigned int MAX_CLUSTER_VERTICES = 64;
+static const unsigned int MAX_CLUSTER_TRIANGLES = 124;
+
+ClusterSet::ClusterSet()
+{
+	clusterCount = 0;
+}
+
+void ClusterSet::Build(const std::vector<GLfloat>& vertices, unsigned int vertexLength,
+					const std::vector<unsigned int>& indices, GLsizei indexCount)
+{
+	Clear();
+
+	unsigned int vertexCount = vertices.size() / vertexLength;
+
+	// greedy runs over the already cache and locality ordered triangles
+	std::vector<GLuint> clusterStarts;
+	std::vector<unsigned int> stamp(vertexCount, ~0u);
+	unsigned int current = ~0u;
+	unsigned int clusterVertices = 0, clusterTriangles = 0;
+
+	for (GLsizei i = 0; i < indexCount; i += 3)
+	{
+		unsigned int newVertices = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			if (stamp[indices[i + k]] != current)
+			{
+				newVertices++;
+			}
+		}
+
+		if (current == ~0u || clusterVertices + newVertices > MAX_CLUSTER_VERTICES || clusterTriangles == MAX_CLUSTER_TRIANGLES)
+		{
+			clusterStarts.push_back(i);
+			current = clusterStarts.size() - 1;
+			clusterVertices = 0;
+			clusterTriangles = 0;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[i + k];
+			if (stamp[v] != current)
+			{
+				stamp[v] = current;
+				clusterVertices++;
+			}
+		}
+		clusterTriangles++;
+	}
+	clusterStarts.push_back(indexCount);
+
+	clusterCount = clusterStarts.size() - 1;
+	GLuint paddedCount = (clusterCount + 3) & ~3u;
+
+	centreX.assign(paddedCount, 0.0f); centreY.assign(paddedCount, 0.0f); centreZ.assign(paddedCount, 0.0f);
+	radius.assign(paddedCount, -FLT_MAX);
+	coneX.assign(paddedCount, 0.0f); coneY.assign(paddedCount, 0.0f); coneZ.assign(paddedCount, 0.0f);
+	coneCutoff.assign(paddedCount, 2.0f);
+	indexOffset.assign(paddedCount, 0);
+	this->indexCount.assign(paddedCount, 0);
+
+	for (GLuint c = 0; c < clusterCount; c++)
+	{
+		GLuint first = clusterStarts[c], last = clusterStarts[c + 1];
+
+		indexOffset[c] = first;
+		this->indexCount[c] = last - first;
+
+		// sphere around the vertex centroid
+		glm::vec3 centre(0.0f, 0.0f, 0.0f);
+		for (GLuint i = first; i < last; i++)
+		{
+			const GLfloat* p = &vertices[indices[i] * vertexLength];
+			centre += glm::vec3(p[0], p[1], p[2]);
+		}
+		centre /= (GLfloat)(last - first);
+
+		GLfloat clusterRadius = 0.0f;
+		for (GLuint i = first; i < last; i++)
+		{
+			const GLfloat* p = &vertices[indices[i] * vertexLength];
+			clusterRadius = glm::max(clusterRadius, glm::length(glm::vec3(p[0], p[1], p[2]) - centre));
+		}
+
+		centreX[c] = centre.x; centreY[c] = centre.y; centreZ[c] = centre.z;
+		radius[c] = clusterRadius;
+
+		// normal cone from the winding order, so it covers what the rasterizer would call front facing
+		std::vector<glm::vec3> faceNormals;
+		glm::vec3 axis(0.0f, 0.0f, 0.0f);
+		for (GLuint i = first; i < last; i += 3)
+		{
+			const GLfloat* p0 = &vertices[indices[i] * vertexLength];
+			const GLfloat* p1 = &vertices[indices[i + 1] * vertexLength];
+			const GLfloat* p2 = &vertices[indices[i + 2] * vertexLength];
+
+			glm::vec3 normal = glm::cross(glm::vec3(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]),
+										glm::vec3(p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]));
+			GLfloat length = glm::length(normal);
+			if (length > 0.0f)
+			{
+				faceNormals.push_back(normal / length);
+				axis += normal / length;
+			}
+		}
+
+		GLfloat axisLength = glm::length(axis);
+		if (axisLength <= 0.0f)
+		{
+			continue;
+		}
+		axis /= axisLength;
+
+		GLfloat minDot = 1.0f;
+		for (size_t i = 0; i < faceNormals.size(); i++)
+		{
+			minDot = glm::min(minDot, glm::dot(axis, faceNormals[i]));
+		}
+
+		// every face is back facing once the view direction is within 90 degrees minus the cone
+		// angle of the axis; cones of 90 degrees or more keep the out of range cutoff and never cull
+		if (minDot > 0.0f)
+		{
+			coneX[c] = axis.x; coneY[c] = axis.y; coneZ[c] = axis.z;
+			coneCutoff[c] = sqrtf(1.0f - minDot * minDot);
+		}
+	}
+}
+
+GLuint ClusterSet::Cull(const ClusterView& view, GLuint indexSize, std::vector<GLsizei>& counts, std::vector<const void*>& offsets) const
+{
+	counts.clear();
+	offsets.clear();
+
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::vec4& plane = view.frustum.GetPlane(i);
+		planeX[i] = _mm_set1_ps(plane.x);
+		planeY[i] = _mm_set1_ps(plane.y);
+		planeZ[i] = _mm_set1_ps(plane.z);
+		planeW[i] = _mm_set1_ps(plane.w);
+	}
+
+	__m128 eyeX = _mm_set1_ps(view.viewPosition.x);
+	__m128 eyeY = _mm_set1_ps(view.viewPosition.y);
+	__m128 eyeZ = _mm_set1_ps(view.viewPosition.z);
+	__m128 zero = _mm_setzero_ps();
+
+	GLuint culled = 0;
+	GLuint rangeEnd = ~0u;
+
+	for (GLuint c = 0; c < clusterCount; c += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&centreX[c]);
+		__m128 cy = _mm_loadu_ps(&centreY[c]);
+		__m128 cz = _mm_loadu_ps(&centreZ[c]);
+		__m128 r = _mm_loadu_ps(&radius[c]);
+		__m128 negR = _mm_sub_ps(zero, r);
+
+		// inside or touching every plane
+		__m128 visible = _mm_cmpge_ps(r, zero);
+		for (int i = 0; i < 6; i++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, planeX[i]), _mm_mul_ps(cy, planeY[i])),
+										_mm_add_ps(_mm_mul_ps(cz, planeZ[i]), planeW[i]));
+			visible = _mm_and_ps(visible, _mm_cmpgt_ps(distance, negR));
+		}
+
+		if (view.cullBackfaces)
+		{
+			// culled when dot(centre - eye, axis) >= cutoff * |centre - eye| + radius
+			__m128 dx = _mm_sub_ps(cx, eyeX);
+			__m128 dy = _mm_sub_ps(cy, eyeY);
+			__m128 dz = _mm_sub_ps(cz, eyeZ);
+			__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+
+			__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&coneX[c])), _mm_mul_ps(dy, _mm_loadu_ps(&coneY[c]))),
+									_mm_mul_ps(dz, _mm_loadu_ps(&coneZ[c])));
+			__m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&coneCutoff[c]), distance), r);
+
+			visible = _mm_andnot_ps(_mm_cmpge_ps(along, limit), visible);
+		}
+
+		int mask = _mm_movemask_ps(visible);
+		for (GLuint k = 0; k < 4 && c + k < clusterCount; k++)
+		{
+			if (!(mask & (1 << k)))
+			{
+				culled++;
+				continue;
+			}
+
+			// extend the previous range when this cluster follows straight on from it
+			if (indexOffset[c + k] == rangeEnd)
+			{
+				counts.back() += indexCount[c + k];
+			}
+			else {
+				counts.push_back(indexCount[c + k]);
+				offsets.push_back((const void*)(size_t)(indexOffset[c + k] * indexSize));
+			}
+			rangeEnd = indexOffset[c + k] + indexCount[c + k];
+		}
+	}
+
+	return culled;
+}
+
+void ClusterSet::Clear()
+{
+	clusterCount = 0;
+	centreX.clear(); centreY.clear(); centreZ.clear(); radius.clear();
+	coneX.clear(); coneY.clear(); coneZ.clear(); coneCutoff.clear();
+	indexOffset.clear();
+	indexCount.clear();
+}
+
+ClusterSet::~ClusterSet()
+{
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+// What a cluster set is culled against, in the mesh's object space
+struct ClusterView
+{
+	Frustum frustum;
+	glm::vec3 viewPosition;
+	bool cullBackfaces;
+};
+
+// A mesh's top level of detail cut into clusters of at most 64 vertices and 124 triangles,
+// each with a bounding sphere and a cone bounding its face normals. Clusters are contiguous
+// runs of the index buffer and are kept in SoA form so four are tested per SSE instruction.
+class ClusterSet
+{
+public:
+	ClusterSet();
+
+	void Build(const std::vector<GLfloat>& vertices, unsigned int vertexLength,
+			const std::vector<unsigned int>& indices, GLsizei indexCount);
+	void Clear();
+
+	// Fills counts/offsets with the visible index ranges, neighbouring ranges merged, and returns
+	// how many clusters were culled. indexSize is the index buffer's element size in bytes.
+	GLuint Cull(const ClusterView& view, GLuint indexSize, std::vector<GLsizei>& counts, std::vector<const void*>& offsets) const;
+
+	GLuint GetClusterCount() const { return clusterCount; }
+
+	~ClusterSet();
+
+private:
+	GLuint clusterCount;
+
+	// padded to a multiple of four; padding has a negative radius and never passes
+	std::vector<GLfloat> centreX, centreY, centreZ, radius;
+	std::vector<GLfloat> coneX, coneY, coneZ, coneCutoff;
+	std::vector<GLuint> indexOffset;
+	std::vector<GLsizei> indexCount;
+};
+
@@ -6,4 +6,36 @@
 const int MAX_POINT_LIGHTS = 3;
 const int MAX_SPOT_LIGHTS = 3;
 
+// omni shadow atlases, one per shadow resolution tier and filter; a single moment atlas holds
+// every omni light
+const int MAX_DEPTH_SHADOW_ATLASES = 2;
+const int MAX_MOMENT_SHADOW_ATLASES = 1;
+const int MAX_SHADOW_ATLASES = MAX_DEPTH_SHADOW_ATLASES + MAX_MOMENT_SHADOW_ATLASES;
+
+// post-transform cache size used when measuring imported meshes
+const unsigned int MESH_CACHE_SIZE = 16;
+
+// meshes with more vertices than this need 32-bit indices; imported ones are split instead
+const unsigned int MAX_SHORT_INDEX_VERTICES = 65536;
+
+// imported meshes get up to this many levels of detail, each with half the triangles of the last
+const unsigned int MAX_MESH_LODS = 5;
+
+// forward shading evaluates at most this many lights per object, picked per draw and passed
+// to the shader as one ivec4 vertex attribute at this location
+const int MAX_OBJECT_LIGHTS = 4;
+const unsigned int OBJECT_LIGHTS_ATTRIBUTE = 3;
+
+// a light's influence ends where its attenuated intensity falls below this, too dim to change
+// an 8-bit colour channel
+const float LIGHT_INTENSITY_CUTOFF = 1.0f / 256.0f;
+
+// the highest specular intensity a material may have; light ranges count on highlights this
+// bright, which add to the light's colour on top of its ambient and diffuse intensities
+const float MAX_SPECULAR_INTENSITY = 4.0f;
+
+// GPU culling keeps the draw commands of every pass in a frame apart: the camera, the
+// directional light and one per shadow casting omni light
+const unsigned int MAX_CULL_PASSES = 2 + MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS;
+
 #endif COMMONVALS
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "DirectionalLight.h"
 
+#include "Shader.h"
+
 DirectionalLight::DirectionalLight() : Light()
 {
 	direction = glm::vec3(0.0f, -1.0f, 0.0f);  // an arrow pointing straight down
@@ -19,11 +21,32 @@ DirectionalLight::DirectionalLight(GLfloat shadowWidth, GLfloat shadowHeight,
 void DirectionalLight::UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColourLocation,
 							GLfloat diffuseIntensityLocation, GLfloat directionLocation)
 {
-	glUniform3f(ambientColourLocation, colour.x, colour.y, colour.z);
-	glUniform1f(ambientIntensityLocation, ambientIntensity);
+	Shader::Uniform3f(ambientColourLocation, colour.x, colour.y, colour.z);
+	Shader::Uniform1f(ambientIntensityLocation, ambientIntensity);
+
+	Shader::Uniform3f(directionLocation, direction.x, direction.y, direction.z);
+	Shader::Uniform1f(diffuseIntensityLocation, diffuseIntensity);
+}
+
+void DirectionalLight::SetShadowFilter(ShadowFilter filter)
+{
+	if (!shadowMap || shadowMap->GetFilter() == filter)
+	{
+		return;
+	}
+
+	GLuint width = shadowMap->GetShadowWidth();
+	GLuint height = shadowMap->GetShadowHeight();
 
-	glUniform3f(directionLocation, direction.x, direction.y, direction.z);
-	glUniform1f(diffuseIntensityLocation, diffuseIntensity);
+	delete shadowMap;
+	if (filter == SHADOW_FILTER_VSM)
+	{
+		shadowMap = new VarianceShadowMap();
+	}
+	else {
+		shadowMap = new ShadowMap();
+	}
+	shadowMap->Init(width, height);
 }
 
 glm::mat4 DirectionalLight::CalculateLightTransform()
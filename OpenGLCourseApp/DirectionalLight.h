@@ -1,5 +1,6 @@
 #pragma once
 #include "Light.h"
+#include "VarianceShadowMap.h"
 class DirectionalLight :
 	public Light
 {
@@ -14,6 +15,8 @@ public:
 	void UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColourLocation,
 				GLfloat diffuseIntensityLocation, GLfloat directionLocation);
 
+	void SetShadowFilter(ShadowFilter filter);
+
 	glm::mat4 CalculateLightTransform();
 
 	~DirectionalLight();
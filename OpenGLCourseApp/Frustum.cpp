@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "Frustum.h"
+
+Frustum::Frustum()
+{
+	for (size_t i = 0; i < 6; i++)
+	{
+		planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	// Gribb/Hartmann: each plane is the fourth row plus or minus one of the other rows
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+
+	for (size_t i = 0; i < 6; i++)
+	{
+		planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool Frustum::TestBox(const BoundingBox& box) const
+{
+	glm::vec3 minCorner = box.GetMin();
+	glm::vec3 maxCorner = box.GetMax();
+
+	for (size_t i = 0; i < 6; i++)
+	{
+		// the corner furthest along the plane normal
+		glm::vec3 positive(planes[i].x >= 0.0f ? maxCorner.x : minCorner.x,
+						planes[i].y >= 0.0f ? maxCorner.y : minCorner.y,
+						planes[i].z >= 0.0f ? maxCorner.z : minCorner.z);
+
+		if (glm::dot(glm::vec3(planes[i]), positive) + planes[i].w < 0.0f)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Frustum::TestSphere(glm::vec3 centre, GLfloat radius) const
+{
+	for (size_t i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), centre) + planes[i].w < -radius)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+Frustum::~Frustum()
+{
+}
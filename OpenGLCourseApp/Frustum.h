@@ -0,0 +1,26 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "BoundingBox.h"
+
+// The six clip planes of a view-projection matrix, used to reject boxes and spheres.
+class Frustum
+{
+public:
+	Frustum();
+	Frustum(const glm::mat4& viewProjection);
+
+	bool TestBox(const BoundingBox& box) const;
+	bool TestSphere(glm::vec3 centre, GLfloat radius) const;
+
+	const glm::vec4& GetPlane(int index) const { return planes[index]; }
+
+	~Frustum();
+
+private:
+	// left, right, bottom, top, near, far; normals point inwards
+	glm::vec4 planes[6];
+};
+
@@ -0,0 +1,92 @@
+#include "pch.h"
+#include "GBuffer.h"
+
+GBuffer::GBuffer()
+{
+	FBO = 0;
+	albedoTexture = 0;
+	surfaceTexture = 0;
+	depthTexture = 0;
+	width = 0;
+	height = 0;
+}
+
+bool GBuffer::Init(GLuint width, GLuint height)
+{
+	this->width = width;
+	this->height = height;
+
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+	GLuint* textures[3] = { &albedoTexture, &surfaceTexture, &depthTexture };
+	GLenum formats[3] = { GL_RGBA8, GL_RGBA16F, GL_DEPTH_COMPONENT24 };
+	GLenum dataFormats[3] = { GL_RGBA, GL_RGBA, GL_DEPTH_COMPONENT };
+	GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_DEPTH_ATTACHMENT };
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		glGenTextures(1, textures[i]);
+		glBindTexture(GL_TEXTURE_2D, *textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, formats[i], width, height, 0, dataFormats[i], GL_FLOAT, nullptr);
+		// read one texel per pixel, never filtered
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, *textures[i], 0);
+	}
+
+	GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("G-buffer Framebuffer Error: %i\n", status);
+		return false;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return true;
+}
+
+void GBuffer::Write()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glViewport(0, 0, width, height);
+
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GBuffer::Read(GLenum albedoUnit, GLenum surfaceUnit, GLenum depthUnit)
+{
+	glActiveTexture(albedoUnit);
+	glBindTexture(GL_TEXTURE_2D, albedoTexture);
+
+	glActiveTexture(surfaceUnit);
+	glBindTexture(GL_TEXTURE_2D, surfaceTexture);
+
+	glActiveTexture(depthUnit);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+}
+
+GBuffer::~GBuffer()
+{
+	if (FBO)
+	{
+		glDeleteFramebuffers(1, &FBO);
+	}
+
+	if (albedoTexture)
+	{
+		glDeleteTextures(1, &albedoTexture);
+		glDeleteTextures(1, &surfaceTexture);
+		glDeleteTextures(1, &depthTexture);
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdio.h>
+#include <GL/glew.h>
+
+// Surface attributes of the camera view for deferred lighting, 16 bytes a pixel:
+// albedo (RGBA8), octahedral normal with specular intensity and shininess (RGBA16F), depth.
+// Positions are rebuilt from depth, so there is no position target.
+class GBuffer
+{
+public:
+	GBuffer();
+
+	bool Init(GLuint width, GLuint height);
+
+	void Write();
+
+	void Read(GLenum albedoUnit, GLenum surfaceUnit, GLenum depthUnit);
+
+	GLuint GetWidth() { return width; }
+	GLuint GetHeight() { return height; }
+
+	~GBuffer();
+
+private:
+	GLuint FBO, albedoTexture, surfaceTexture, depthTexture;
+	GLuint width, height;
+};
+
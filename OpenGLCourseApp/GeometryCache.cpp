@@ -0,0 +1,91 @@
+#include "pch.h"
+#include "GeometryCache.h"
+
+#include <string.h>
+#include <vector>
+
+std::unordered_map<unsigned long long, GeometryCache::Entry> GeometryCache::entries;
+GLuint GeometryCache::sharedBytes = 0;
+
+unsigned long long GeometryCache::Hash(const void* data, size_t bytes, unsigned long long seed)
+{
+	// FNV-1a, 64-bit
+	const unsigned char* p = (const unsigned char*)data;
+	unsigned long long hash = seed ? seed : 14695981039346656037ull;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+GeometryCache::Entry* GeometryCache::Acquire(unsigned long long key, GLuint layout, GLenum indexType,
+	const void* vertexData, GLuint vertexBytes, const void* indexData, GLuint indexBytes)
+{
+	auto it = entries.find(key);
+	if (it == entries.end())
+	{
+		return nullptr;
+	}
+
+	Entry& entry = it->second;
+	if (entry.layout != layout || entry.indexType != indexType ||
+		entry.vertexBytes != vertexBytes || entry.indexBytes != indexBytes ||
+		!BufferMatches(entry.VBO, vertexData, vertexBytes) || !BufferMatches(entry.IBO, indexData, indexBytes))
+	{
+		return nullptr;
+	}
+
+	it->second.refCount++;
+	sharedBytes += it->second.vertexBytes + it->second.indexBytes;
+
+	return &it->second;
+}
+
+bool GeometryCache::Insert(unsigned long long key, const Entry& entry)
+{
+	if (entries.find(key) != entries.end())
+	{
+		return false;
+	}
+
+	entries[key] = entry;
+	entries[key].refCount = 1;
+
+	return true;
+}
+
+bool GeometryCache::BufferMatches(GLuint buffer, const void* data, GLuint bytes)
+{
+	// the copy target leaves the array and element array bindings alone
+	std::vector<unsigned char> stored(bytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, bytes, stored.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	return memcmp(stored.data(), data, bytes) == 0;
+}
+
+void GeometryCache::Release(unsigned long long key)
+{
+	auto it = entries.find(key);
+	if (it == entries.end())
+	{
+		return;
+	}
+
+	Entry& entry = it->second;
+	if (--entry.refCount > 0)
+	{
+		sharedBytes -= entry.vertexBytes + entry.indexBytes;
+		return;
+	}
+
+	glDeleteBuffers(1, &entry.IBO);
+	glDeleteBuffers(1, &entry.VBO);
+	glDeleteVertexArrays(1, &entry.VAO);
+
+	entries.erase(it);
+}
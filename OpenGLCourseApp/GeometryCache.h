@@ -0,0 +1,44 @@
+#pragma once
+
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+// Vertex arrays and buffers shared between meshes created from identical data, keyed by a
+// hash of that data and reference counted so the last mesh to let go deletes them.
+// A key is only shared once the layout, sizes and buffer contents match, so a hash collision
+// costs a separate upload rather than drawing the wrong geometry.
+class GeometryCache
+{
+public:
+	struct Entry {
+		GLuint VAO, VBO, IBO;
+		GLuint layout;
+		GLenum indexType;
+		GLuint vertexBytes, indexBytes;
+		unsigned int refCount;
+	};
+
+	static unsigned long long Hash(const void* data, size_t bytes, unsigned long long seed);
+
+	// Returns the entry with one more reference, or null if nothing matches. A hit is compared
+	// with the buffers it would share; reading them back stalls, but only happens while loading.
+	static Entry* Acquire(unsigned long long key, GLuint layout, GLenum indexType,
+		const void* vertexData, GLuint vertexBytes, const void* indexData, GLuint indexBytes);
+
+	// false if another upload already holds the key, which the caller then owns by itself
+	static bool Insert(unsigned long long key, const Entry& entry);
+	static void Release(unsigned long long key);
+
+	static size_t GetEntryCount() { return entries.size(); }
+	static GLuint GetSharedBytes() { return sharedBytes; }
+
+private:
+	static std::unordered_map<unsigned long long, Entry> entries;
+
+	static bool BufferMatches(GLuint buffer, const void* data, GLuint bytes);
+
+	// buffer memory not allocated because an identical upload already existed
+	static GLuint sharedBytes;
+};
+
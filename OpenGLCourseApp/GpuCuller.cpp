@@ -0,0 +1,296 @@
+#include "pch.h"
+#include "GpuCuller.h"
+
+#include <algorithm>
+
+#include <glm/gtc/type_ptr.hpp>
+
+// matches struct Object in cull_draws.comp under std430
+struct CullObject {
+	GLfloat boundsMin[4];
+	GLfloat boundsMax[4];
+	GLuint indexCount;
+	GLuint firstIndex;
+	GLuint bucket;
+	GLuint bucketBase;
+};
+
+// a DrawElementsIndirectCommand
+static const GLuint COMMAND_SIZE = 5 * sizeof(GLuint);
+
+GpuCuller::GpuCuller()
+{
+	objectCount = 0;
+	passCount = 0;
+
+	objectBuffer = 0;
+	commandBuffer = 0;
+	countBuffer = 0;
+	lightBuffer = 0;
+
+	width = 0;
+	height = 0;
+	depthTexture = 0;
+	hizTexture = 0;
+	hizLevels = 0;
+	hizValid = false;
+
+	cullShader = nullptr;
+	hizShader = nullptr;
+}
+
+bool GpuCuller::Init(const std::vector<StaticBatch::Draw>& draws, GLuint width, GLuint height)
+{
+	if (!GLEW_VERSION_4_3)
+	{
+		printf("GPU culling needs OpenGL 4.3, culling on the CPU instead\n");
+		return false;
+	}
+
+	// the batch keeps draws of one mesh together, each such run is a bucket
+	std::vector<CullObject> objects;
+	for (size_t i = 0; i < draws.size(); i++)
+	{
+		if (buckets.empty() || buckets.back().mesh != draws[i].mesh)
+		{
+			buckets.push_back({ draws[i].mesh, draws[i].texture, draws[i].material, (GLuint)i, 0 });
+		}
+		buckets.back().drawCount++;
+
+		glm::vec3 boundsMin = draws[i].bounds.GetMin(), boundsMax = draws[i].bounds.GetMax();
+
+		CullObject object = {
+			{ boundsMin.x, boundsMin.y, boundsMin.z, 0.0f },
+			{ boundsMax.x, boundsMax.y, boundsMax.z, 0.0f },
+			(GLuint)draws[i].indexCount, draws[i].indexOffset,
+			(GLuint)buckets.size() - 1, buckets.back().firstDraw
+		};
+		objects.push_back(object);
+	}
+
+	objectCount = objects.size();
+	if (objectCount == 0)
+	{
+		return false;
+	}
+
+	glGenBuffers(1, &objectBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(CullObject) * objects.size(), &objects[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &commandBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, COMMAND_SIZE * objectCount * MAX_CULL_PASSES, nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &countBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * buckets.size() * MAX_CULL_PASSES, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glGenBuffers(1, &lightBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, lightBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLint) * MAX_OBJECT_LIGHTS * objectCount, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// full resolution copy of the depth buffer, then a pyramid starting at half of that
+	this->width = width;
+	this->height = height;
+
+	glGenTextures(1, &depthTexture);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	GLuint levelWidth = std::max(1u, width / 2), levelHeight = std::max(1u, height / 2);
+	hizLevels = 1;
+	while ((levelWidth >> hizLevels) > 0 || (levelHeight >> hizLevels) > 0)
+	{
+		hizLevels++;
+	}
+
+	glGenTextures(1, &hizTexture);
+	glBindTexture(GL_TEXTURE_2D, hizTexture);
+	glTexStorage2D(GL_TEXTURE_2D, hizLevels, GL_R32F, levelWidth, levelHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	cullShader = new Shader();
+	cullShader->CreateFromFile("Shaders/cull_draws.comp");
+
+	hizShader = new Shader();
+	hizShader->CreateFromFile("Shaders/hiz_build.comp");
+
+	printf("GPU culling: %u draws in %u indirect buckets, %u level depth pyramid\n", objectCount, (GLuint)buckets.size(), hizLevels);
+
+	return true;
+}
+
+void GpuCuller::BeginFrame()
+{
+	passCount = 0;
+}
+
+GLuint GpuCuller::Cull(const glm::mat4& viewProjection, bool occlusion)
+{
+	return Dispatch(viewProjection, glm::vec4(0.0f, 0.0f, 0.0f, 0.0f), occlusion && hizValid);
+}
+
+GLuint GpuCuller::Cull(glm::vec3 centre, GLfloat radius)
+{
+	return Dispatch(glm::mat4(1.0f), glm::vec4(centre, radius), false);
+}
+
+GLuint GpuCuller::Dispatch(const glm::mat4& viewProjection, glm::vec4 sphere, bool occlusion)
+{
+	// more passes than slots would overwrite commands an earlier pass may still be drawing from
+	GLuint pass = passCount % MAX_CULL_PASSES;
+	passCount++;
+
+	// cleared commands draw nothing, which is all the fallback without a draw count relies on
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, COMMAND_SIZE * objectCount * pass, COMMAND_SIZE * objectCount,
+						GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, sizeof(GLuint) * buckets.size() * pass, sizeof(GLuint) * buckets.size(),
+						GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	Shader* previousShader = Shader::GetBoundShader();
+
+	cullShader->UseShader();
+
+	Shader::UniformMatrix4fv(cullShader->GetViewProjectionLocation(), viewProjection);
+	Shader::UniformMatrix4fv(cullShader->GetOcclusionViewProjectionLocation(), hizViewProjection);
+	Shader::Uniform4f(cullShader->GetCullSphereLocation(), sphere.x, sphere.y, sphere.z, sphere.w);
+	Shader::Uniform1i(cullShader->GetOcclusionLocation(), occlusion);
+	Shader::Uniform1ui(cullShader->GetCommandBaseLocation(), objectCount * pass);
+	Shader::Uniform1ui(cullShader->GetCountBaseLocation(), buckets.size() * pass);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, hizTexture);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, countBuffer);
+
+	glDispatchCompute((objectCount + 63) / 64, 1, 1);
+
+	// the commands and counts are read by the draws that follow
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+	Shader::Rebind(previousShader);
+
+	return pass;
+}
+
+void GpuCuller::SetObjectLights(const std::vector<GLint>& lights)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, lightBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLint) * MAX_OBJECT_LIGHTS * objectCount, &lights[0]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GpuCuller::Render(GLuint pass, GLuint uniformSpecularIntensity, GLuint uniformShininess, bool objectLights)
+{
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	if (GLEW_ARB_indirect_parameters)
+	{
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, countBuffer);
+	}
+
+	for (size_t i = 0; i < buckets.size(); i++)
+	{
+		buckets[i].texture->UseTexture();
+		buckets[i].material->UseMaterial(uniformSpecularIntensity, uniformShininess);
+
+		// each command's baseInstance is its draw's index, which picks its row of lights
+		if (objectLights)
+		{
+			buckets[i].mesh->SetInstanceAttribute(OBJECT_LIGHTS_ATTRIBUTE, lightBuffer, MAX_OBJECT_LIGHTS);
+		}
+
+		GLintptr commandOffset = COMMAND_SIZE * (objectCount * pass + buckets[i].firstDraw);
+		if (GLEW_ARB_indirect_parameters)
+		{
+			buckets[i].mesh->RenderIndirect(commandOffset, sizeof(GLuint) * (buckets.size() * pass + i), buckets[i].drawCount);
+		}
+		else {
+			buckets[i].mesh->RenderIndirect(commandOffset, buckets[i].drawCount);
+		}
+
+		if (objectLights)
+		{
+			buckets[i].mesh->SetInstanceAttribute(OBJECT_LIGHTS_ATTRIBUTE, 0, MAX_OBJECT_LIGHTS);
+		}
+	}
+
+	if (GLEW_ARB_indirect_parameters)
+	{
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GpuCuller::UpdateOcclusion(const glm::mat4& viewProjection)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+	Shader* previousShader = Shader::GetBoundShader();
+
+	hizShader->UseShader();
+	glActiveTexture(GL_TEXTURE0);
+
+	for (GLuint level = 0; level < hizLevels; level++)
+	{
+		// level 0 reduces the depth copy, every other level the one before it
+		if (level == 0)
+		{
+			glBindTexture(GL_TEXTURE_2D, depthTexture);
+			Shader::Uniform1i(hizShader->GetSourceLevelLocation(), 0);
+		}
+		else {
+			glBindTexture(GL_TEXTURE_2D, hizTexture);
+			Shader::Uniform1i(hizShader->GetSourceLevelLocation(), level - 1);
+		}
+
+		glBindImageTexture(0, hizTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		GLuint levelWidth = std::max(1u, (width / 2) >> level), levelHeight = std::max(1u, (height / 2) >> level);
+		glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	Shader::Rebind(previousShader);
+
+	hizViewProjection = viewProjection;
+	hizValid = true;
+}
+
+GpuCuller::~GpuCuller()
+{
+	if (objectBuffer)
+	{
+		glDeleteBuffers(1, &objectBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+		glDeleteBuffers(1, &countBuffer);
+		glDeleteBuffers(1, &lightBuffer);
+	}
+
+	if (depthTexture)
+	{
+		glDeleteTextures(1, &depthTexture);
+		glDeleteTextures(1, &hizTexture);
+	}
+
+	delete cullShader;
+	delete hizShader;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "CommonValues.h"
+#include "Shader.h"
+#include "StaticBatch.h"
+
+// Culls the static batch on the GPU. A compute shader tests every chunk against the pass's
+// frustum or light sphere and, in the camera pass, against a depth pyramid built from the
+// previous frame, then packs the visible draws of each mesh into indirect commands so a whole
+// mesh is drawn with one call and the CPU never looks at individual chunks.
+// Needs OpenGL 4.3; Init fails without it and the caller keeps culling on the CPU.
+class GpuCuller
+{
+public:
+	GpuCuller();
+
+	bool Init(const std::vector<StaticBatch::Draw>& draws, GLuint width, GLuint height);
+
+	// commands are written per pass; the slots are reused from the next BeginFrame
+	void BeginFrame();
+	GLuint Cull(const glm::mat4& viewProjection, bool occlusion);
+	GLuint Cull(glm::vec3 centre, GLfloat radius);
+
+	// MAX_OBJECT_LIGHTS light indices per draw, in batch order, -1 after the last
+	void SetObjectLights(const std::vector<GLint>& lights);
+
+	// with objectLights every draw reads its own list from the last SetObjectLights
+	void Render(GLuint pass, GLuint uniformSpecularIntensity, GLuint uniformShininess, bool objectLights);
+
+	// builds the depth pyramid from the depth buffer of the default framebuffer
+	void UpdateOcclusion(const glm::mat4& viewProjection);
+
+	~GpuCuller();
+
+private:
+	struct Bucket {
+		Mesh* mesh;
+		Texture* texture;
+		Material* material;
+		GLuint firstDraw;
+		GLuint drawCount;
+	};
+
+	GLuint Dispatch(const glm::mat4& viewProjection, glm::vec4 sphere, bool occlusion);
+
+	std::vector<Bucket> buckets;
+	GLuint objectCount;
+	GLuint passCount;
+
+	GLuint objectBuffer, commandBuffer, countBuffer, lightBuffer;
+
+	GLuint width, height;
+	GLuint depthTexture, hizTexture;
+	GLuint hizLevels;
+	glm::mat4 hizViewProjection;
+	bool hizValid;
+
+	Shader* cullShader;
+	Shader* hizShader;
+};
+
@@ -6,6 +6,8 @@ Light::Light()
 	colour = glm::vec3(1.0f, 1.0f, 1.0f);
 	ambientIntensity = 1.0f;
 	diffuseIntensity = 0.0f;
+
+	shadowMap = nullptr;
 }
 
 Light::Light(GLfloat shadowWidth, GLfloat shadowHeight, GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity)
@@ -0,0 +1,145 @@
+#include "pch.h"
+#include "LightAssigner.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <xmmintrin.h>
+
+// padding lights sit this far away, out of reach of anything
+static const GLfloat FAR_AWAY = 1e30f;
+
+LightAssigner::LightAssigner()
+{
+	points.count = 0;
+	spots.count = 0;
+}
+
+void LightAssigner::Clear()
+{
+	LightSet* sets[2] = { &points, &spots };
+	for (int i = 0; i < 2; i++)
+	{
+		LightSet& set = *sets[i];
+		set.positionX.clear(); set.positionY.clear(); set.positionZ.clear();
+		set.range.clear(); set.intensity.clear();
+		set.directionX.clear(); set.directionY.clear(); set.directionZ.clear();
+		set.cosAngle.clear(); set.sinAngle.clear();
+		set.count = 0;
+	}
+}
+
+void LightAssigner::AddPointLight(glm::vec3 position, GLfloat range, GLfloat intensity)
+{
+	Add(points, position, range, intensity, glm::vec3(0.0f, -1.0f, 0.0f), -1.0f);
+}
+
+void LightAssigner::AddSpotLight(glm::vec3 position, glm::vec3 direction, GLfloat cosAngle, GLfloat range, GLfloat intensity)
+{
+	Add(spots, position, range, intensity, direction, cosAngle);
+}
+
+void LightAssigner::Add(LightSet& set, glm::vec3 position, GLfloat range, GLfloat intensity, glm::vec3 direction, GLfloat cosAngle)
+{
+	// overwrite the padding of the last block, or start a new one
+	if (set.count % 4 == 0)
+	{
+		size_t size = set.count + 4;
+		set.positionX.resize(size, FAR_AWAY); set.positionY.resize(size, FAR_AWAY); set.positionZ.resize(size, FAR_AWAY);
+		set.range.resize(size, 0.0f); set.intensity.resize(size, 0.0f);
+		set.directionX.resize(size, 0.0f); set.directionY.resize(size, -1.0f); set.directionZ.resize(size, 0.0f);
+		set.cosAngle.resize(size, 1.0f); set.sinAngle.resize(size, 0.0f);
+	}
+
+	GLuint i = set.count++;
+	set.positionX[i] = position.x; set.positionY[i] = position.y; set.positionZ[i] = position.z;
+	set.range[i] = range;
+	set.intensity[i] = intensity;
+	set.directionX[i] = direction.x; set.directionY[i] = direction.y; set.directionZ[i] = direction.z;
+	set.cosAngle[i] = cosAngle;
+	set.sinAngle[i] = sqrtf(std::max(1.0f - cosAngle * cosAngle, 0.0f));
+}
+
+GLuint LightAssigner::Assign(const BoundingBox& bounds, GLuint* indices, GLuint maxLights)
+{
+	candidates.clear();
+
+	glm::vec3 centre = bounds.GetCentre();
+	GLfloat radius = bounds.GetRadius();
+
+	Test(points, false, centre, radius, 0);
+	Test(spots, true, centre, radius, points.count);
+
+	GLuint count = std::min((GLuint)candidates.size(), maxLights);
+	std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+		[](const std::pair<GLfloat, GLuint>& a, const std::pair<GLfloat, GLuint>& b) {
+			return a.first > b.first;
+		});
+
+	for (GLuint i = 0; i < count; i++)
+	{
+		indices[i] = candidates[i].second;
+	}
+
+	return count;
+}
+
+void LightAssigner::Test(const LightSet& set, bool cones, glm::vec3 centre, GLfloat radius, GLuint indexBase)
+{
+	__m128 cx = _mm_set1_ps(centre.x);
+	__m128 cy = _mm_set1_ps(centre.y);
+	__m128 cz = _mm_set1_ps(centre.z);
+	__m128 r = _mm_set1_ps(radius);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+
+	for (GLuint l = 0; l < set.count; l += 4)
+	{
+		__m128 dx = _mm_sub_ps(cx, _mm_loadu_ps(&set.positionX[l]));
+		__m128 dy = _mm_sub_ps(cy, _mm_loadu_ps(&set.positionY[l]));
+		__m128 dz = _mm_sub_ps(cz, _mm_loadu_ps(&set.positionZ[l]));
+		__m128 range = _mm_loadu_ps(&set.range[l]);
+
+		// spheres touch when the centres are closer than the two radii
+		__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 reach = _mm_add_ps(range, r);
+		__m128 touching = _mm_cmple_ps(distanceSquared, _mm_mul_ps(reach, reach));
+
+		if (cones && _mm_movemask_ps(touching))
+		{
+			// distance from the centre to the cone's side: the perpendicular distance to the axis,
+			// rotated by the cone's angle, minus the part along the axis
+			__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&set.directionX[l])), _mm_mul_ps(dy, _mm_loadu_ps(&set.directionY[l]))),
+									_mm_mul_ps(dz, _mm_loadu_ps(&set.directionZ[l])));
+			__m128 across = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(distanceSquared, _mm_mul_ps(along, along)), zero));
+			__m128 sideDistance = _mm_sub_ps(_mm_mul_ps(across, _mm_loadu_ps(&set.cosAngle[l])), _mm_mul_ps(along, _mm_loadu_ps(&set.sinAngle[l])));
+
+			__m128 outside = _mm_or_ps(_mm_cmpgt_ps(sideDistance, r), _mm_cmplt_ps(along, _mm_sub_ps(zero, r)));
+			touching = _mm_andnot_ps(outside, touching);
+		}
+
+		int mask = _mm_movemask_ps(touching);
+		if (!mask)
+		{
+			continue;
+		}
+
+		// intensity fading linearly to nothing at the light's range, from the object's nearest point
+		__m128 nearest = _mm_max_ps(_mm_sub_ps(_mm_sqrt_ps(distanceSquared), r), zero);
+		__m128 fade = _mm_max_ps(_mm_sub_ps(one, _mm_div_ps(nearest, _mm_max_ps(range, _mm_set1_ps(1e-6f)))), zero);
+		GLfloat significance[4];
+		_mm_storeu_ps(significance, _mm_mul_ps(_mm_loadu_ps(&set.intensity[l]), fade));
+
+		for (GLuint k = 0; k < 4 && l + k < set.count; k++)
+		{
+			if (mask & (1 << k))
+			{
+				candidates.push_back(std::make_pair(significance[k], indexBase + l + k));
+			}
+		}
+	}
+}
+
+LightAssigner::~LightAssigner()
+{
+}
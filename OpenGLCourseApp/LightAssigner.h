@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "BoundingBox.h"
+
+// Picks the lights that matter most to one object, so the forward shader only loops over
+// those. Lights are indexed in the order they were added, point lights before spot lights,
+// which is the order the shader's light arrays are uploaded in. Four lights are tested at
+// once: a sphere test against each light's range and, for spots, a sphere against cone test.
+class LightAssigner
+{
+public:
+	LightAssigner();
+
+	void Clear();
+	void AddPointLight(glm::vec3 position, GLfloat range, GLfloat intensity);
+	void AddSpotLight(glm::vec3 position, glm::vec3 direction, GLfloat cosAngle, GLfloat range, GLfloat intensity);
+
+	// writes up to maxLights indices, brightest at the object first, and returns how many
+	GLuint Assign(const BoundingBox& bounds, GLuint* indices, GLuint maxLights);
+
+	~LightAssigner();
+
+private:
+	// structure of arrays, padded to a multiple of four with lights that reach nothing
+	struct LightSet {
+		std::vector<GLfloat> positionX, positionY, positionZ;
+		std::vector<GLfloat> range, intensity;
+		std::vector<GLfloat> directionX, directionY, directionZ;
+		std::vector<GLfloat> cosAngle, sinAngle;
+		GLuint count;
+	};
+
+	void Add(LightSet& set, glm::vec3 position, GLfloat range, GLfloat intensity, glm::vec3 direction, GLfloat cosAngle);
+	void Test(const LightSet& set, bool cones, glm::vec3 centre, GLfloat radius, GLuint indexBase);
+
+	LightSet points, spots;
+
+	// candidates of the current Assign, as (significance, index)
+	std::vector<std::pair<GLfloat, GLuint>> candidates;
+};
+
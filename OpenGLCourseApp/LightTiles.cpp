@@ -0,0 +1,109 @@
+#include "pch.h"
+#include "LightTiles.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+LightTiles::LightTiles()
+{
+	tileSize = 16;
+	tilesX = 0;
+	tilesY = 0;
+	texture = 0;
+}
+
+bool LightTiles::Init(GLuint width, GLuint height, GLuint tileSize)
+{
+	this->tileSize = tileSize;
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+
+	masks.assign(tilesX * tilesY, 0);
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, tilesX, tilesY, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &masks[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return true;
+}
+
+void LightTiles::Clear()
+{
+	std::fill(masks.begin(), masks.end(), 0);
+}
+
+void LightTiles::AddLight(GLuint bit, glm::vec3 position, GLfloat radius, const glm::mat4& viewProjection)
+{
+	// screen rectangle of the box around the sphere
+	GLfloat minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	bool crossesNear = false;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner = position + glm::vec3((i & 1) ? radius : -radius, (i & 2) ? radius : -radius, (i & 4) ? radius : -radius);
+		glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+
+		if (clip.w <= 0.0f)
+		{
+			crossesNear = true;
+			break;
+		}
+
+		minX = std::min(minX, clip.x / clip.w); maxX = std::max(maxX, clip.x / clip.w);
+		minY = std::min(minY, clip.y / clip.w); maxY = std::max(maxY, clip.y / clip.w);
+	}
+
+	// around the camera the projection flips, so the light may touch any tile
+	if (crossesNear)
+	{
+		minX = -1.0f; minY = -1.0f;
+		maxX = 1.0f; maxY = 1.0f;
+	}
+
+	if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+	{
+		return;
+	}
+
+	int firstX = std::max(0, (int)floorf((minX * 0.5f + 0.5f) * tilesX));
+	int lastX = std::min((int)tilesX - 1, (int)floorf((maxX * 0.5f + 0.5f) * tilesX));
+	int firstY = std::max(0, (int)floorf((minY * 0.5f + 0.5f) * tilesY));
+	int lastY = std::min((int)tilesY - 1, (int)floorf((maxY * 0.5f + 0.5f) * tilesY));
+
+	GLubyte flag = (GLubyte)(1 << bit);
+	for (int y = firstY; y <= lastY; y++)
+	{
+		for (int x = firstX; x <= lastX; x++)
+		{
+			masks[y * tilesX + x] |= flag;
+		}
+	}
+}
+
+void LightTiles::Upload()
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tilesX, tilesY, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &masks[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void LightTiles::Read(GLenum textureUnit)
+{
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+LightTiles::~LightTiles()
+{
+	if (texture)
+	{
+		glDeleteTextures(1, &texture);
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Which lights can reach each screen tile, as one bit per light in an R8UI texture read by the
+// deferred lighting pass. Bits follow the shader's light order: point lights, then spot lights.
+// Built on the CPU from each light's bounding sphere; the scene has too few lights for a
+// compute pass to pay off.
+class LightTiles
+{
+public:
+	LightTiles();
+
+	bool Init(GLuint width, GLuint height, GLuint tileSize);
+
+	void Clear();
+	void AddLight(GLuint bit, glm::vec3 position, GLfloat radius, const glm::mat4& viewProjection);
+	void Upload();
+
+	void Read(GLenum textureUnit);
+
+	GLuint GetTileSize() { return tileSize; }
+
+	~LightTiles();
+
+private:
+	GLuint tileSize, tilesX, tilesY;
+
+	std::vector<GLubyte> masks;
+	GLuint texture;
+};
+
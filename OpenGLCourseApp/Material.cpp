@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "Material.h"
 
+#include "Shader.h"
+
 
 Material::Material()
 {
@@ -12,12 +14,17 @@ Material::Material(GLfloat sIntensity, GLfloat shine)
 {
 	specularIntensity = sIntensity;
 	shininess = shine;
+
+	if (specularIntensity > MAX_SPECULAR_INTENSITY)
+	{
+		printf("Material specular intensity %.2f is above MAX_SPECULAR_INTENSITY, light ranges will cut its highlights short\n", specularIntensity);
+	}
 }
 
 void Material::UseMaterial(GLuint specularIntensityLocation, GLuint shininessLocation)
 {
-	glUniform1f(specularIntensityLocation, specularIntensity);
-	glUniform1f(shininessLocation, shininess);
+	Shader::Uniform1f(specularIntensityLocation, specularIntensity);
+	Shader::Uniform1f(shininessLocation, shininess);
 }
 
 Material::~Material()
@@ -1,6 +1,47 @@
 #include "pch.h"
 #include "Mesh.h"
 
+#include "CommonValues.h"
+#include "GeometryCache.h"
+
+#include <cmath>
+#include <cstring>
+
+static GLushort FloatToHalf(GLfloat value)
+{
+	GLuint bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	GLuint sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	GLuint mantissa = bits & 0x7FFFFF;
+
+	if (exponent <= 0)
+	{
+		// too small for a normal half, flush to signed zero
+		return (GLushort)sign;
+	}
+	if (exponent >= 31)
+	{
+		return (GLushort)(sign | 0x7C00);
+	}
+
+	// round to nearest; a mantissa carry correctly bumps the exponent
+	GLuint half = sign | (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+	{
+		half++;
+	}
+
+	return (GLushort)half;
+}
+
+static GLuint PackSnorm10(GLfloat value)
+{
+	value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (GLuint)((int)floorf(value * 511.0f + 0.5f)) & 0x3FF;
+}
+
 
 Mesh::Mesh()
 {
@@ -8,66 +49,293 @@ Mesh::Mesh()
 	VBO = 0;
 	IBO = 0;
 	indexCount = 0;
+	indexType = GL_UNSIGNED_INT;
+	indexBytes = 0;
+	vertexLayout = VERTEX_LAYOUT_FLOAT;
+	vertexBytes = 0;
+	geometryKey = 0;
+	geometryShared = false;
 }
 
 void Mesh::CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices)
+{
+	CreateMesh(vertices, indices, numOfVertices, numOfIndices, VERTEX_LAYOUT_FLOAT, BoundingBox());
+}
+
+void Mesh::CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices,
+					VertexLayout layout, const BoundingBox& positionRange)
 {
 	indexCount = numOfIndices;
 
+	// until told otherwise the whole index buffer is the only level
+	lods.assign(1, { 0, (GLsizei)numOfIndices, 0.0f });
+
+	bounds = BoundingBox();
+	for (size_t i = 0; i < numOfVertices; i += 8)
+	{
+		bounds.Expand(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+	}
+
+	vertexLayout = layout;
+
+	// 16-bit indices whenever every vertex is addressable with them
+	std::vector<GLushort> shortIndices;
+	const void* indexData = indices;
+	if (numOfVertices / 8 <= MAX_SHORT_INDEX_VERTICES)
+	{
+		shortIndices.assign(indices, indices + numOfIndices);
+
+		indexType = GL_UNSIGNED_SHORT;
+		indexBytes = sizeof(GLushort) * numOfIndices;
+		indexData = &shortIndices[0];
+	}
+	else {
+		indexType = GL_UNSIGNED_INT;
+		indexBytes = sizeof(indices[0]) * numOfIndices;
+	}
+
+	// positions are stored relative to positionRange, [0, 1] along each axis; an empty range keeps them as they are
+	glm::vec3 rangeOrigin(0.0f, 0.0f, 0.0f), rangeScale(1.0f, 1.0f, 1.0f);
+	if (!positionRange.IsEmpty())
+	{
+		rangeOrigin = positionRange.GetMin();
+		rangeScale = 1.0f / glm::max(positionRange.GetMax() - positionRange.GetMin(), glm::vec3(1e-6f, 1e-6f, 1e-6f));
+	}
+
+	unsigned int vertexCount = numOfVertices / 8;
+
+	std::vector<GLuint> packed;
+	std::vector<GLfloat> normalized;
+	const void* vertexData;
+	if (layout == VERTEX_LAYOUT_COMPACT)
+	{
+		// x, y, z, padding as unorm16 | u, v as half | normal as 2_10_10_10
+		packed.resize(vertexCount * 4);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			const GLfloat* v = &vertices[i * 8];
+
+			glm::vec3 position = (glm::vec3(v[0], v[1], v[2]) - rangeOrigin) * rangeScale;
+			GLushort quantized[3];
+			for (int k = 0; k < 3; k++)
+			{
+				GLfloat unorm = position[k] < 0.0f ? 0.0f : (position[k] > 1.0f ? 1.0f : position[k]);
+				quantized[k] = (GLushort)(unorm * 65535.0f + 0.5f);
+			}
+
+			packed[i * 4] = quantized[0] | ((GLuint)quantized[1] << 16);
+			packed[i * 4 + 1] = quantized[2];
+			packed[i * 4 + 2] = FloatToHalf(v[3]) | ((GLuint)FloatToHalf(v[4]) << 16);
+			packed[i * 4 + 3] = PackSnorm10(v[5]) | (PackSnorm10(v[6]) << 10) | (PackSnorm10(v[7]) << 20);
+		}
+
+		vertexBytes = sizeof(packed[0]) * packed.size();
+		vertexData = &packed[0];
+	}
+	else {
+		normalized.assign(vertices, vertices + numOfVertices);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				normalized[i * 8 + k] = (normalized[i * 8 + k] - rangeOrigin[k]) * rangeScale[k];
+			}
+		}
+
+		vertexBytes = sizeof(vertices[0]) * numOfVertices;
+		vertexData = &normalized[0];
+	}
+
+	// identical uploads share the buffers of the first one; the cache checks the bytes, not just the hash
+	geometryKey = GeometryCache::Hash(&layout, sizeof(layout), 0);
+	geometryKey = GeometryCache::Hash(vertexData, vertexBytes, geometryKey);
+	geometryKey = GeometryCache::Hash(indexData, indexBytes, geometryKey);
+
+	GeometryCache::Entry* shared = GeometryCache::Acquire(geometryKey, layout, indexType, vertexData, vertexBytes, indexData, indexBytes);
+	if (shared)
+	{
+		VAO = shared->VAO;
+		VBO = shared->VBO;
+		IBO = shared->IBO;
+		geometryShared = true;
+		return;
+	}
+
 	glGenVertexArrays(1, &VAO);   // create an empty vertex array on GPU and returns its ID.
 	glBindVertexArray(VAO);    // bind the vertex array ID: from now on, related gl operations will work on this vertex array.
 
 	glGenBuffers(1, &IBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * numOfIndices, indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
 
 	glGenBuffers(1, &VBO);   // create an empty vertex buffer on GPU and returns its ID.
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);   // bind it to the target: GL_ARRAY_BUFFER.
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * numOfVertices, vertices, GL_STATIC_DRAW);  // upload vertices data (on CPU) to the VBO on GPU.
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);  // upload vertices data (on CPU) to the VBO on GPU.
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, 0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, (void*)(sizeof(vertices[0]) * 3));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, (void*)(sizeof(vertices[0]) * 5));
-	glEnableVertexAttribArray(2);
+	if (layout == VERTEX_LAYOUT_COMPACT)
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 16, 0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, 16, (void*)8);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 16, (void*)12);
+		glEnableVertexAttribArray(2);
+	}
+	else {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, 0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, (void*)(sizeof(vertices[0]) * 3));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, (void*)(sizeof(vertices[0]) * 5));
+		glEnableVertexAttribArray(2);
+	}
 
 	// unbind
 	glBindBuffer(GL_ARRAY_BUFFER, 0);  // unbind the VBO
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);  // unbind the IBO
 	glBindVertexArray(0);   // unbind the VAO
+
+	// a different upload already holds this key: keep these buffers to this mesh
+	geometryShared = GeometryCache::Insert(geometryKey, { VAO, VBO, IBO, (GLuint)layout, indexType, vertexBytes, indexBytes, 1 });
+}
+
+void Mesh::SetLods(const std::vector<LodLevel>& levels)
+{
+	lods = levels;
+}
+
+GLuint Mesh::SelectLod(GLfloat pixelsPerUnit, GLfloat maxPixelError)
+{
+	// the coarsest level whose error still projects to less than maxPixelError pixels
+	GLuint lod = 0;
+	while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit <= maxPixelError)
+	{
+		lod++;
+	}
+
+	return lod;
+}
+
+void Mesh::BuildClusters(const std::vector<GLfloat>& vertices, const std::vector<unsigned int>& indices)
+{
+	clusters.Build(vertices, 8, indices, lods[0].indexCount);
 }
 
 void Mesh::RenderMesh()
 {
+	RenderMesh(0);
+}
+
+GLuint Mesh::RenderMesh(GLuint lod, const ClusterView* view)
+{
+	if (lod != 0 || !view || clusters.GetClusterCount() == 0)
+	{
+		RenderMesh(lod);
+		return lods[lod].indexCount / 3;
+	}
+
+	clusters.Cull(*view, GetIndexSize(), drawCounts, drawOffsets);
+	if (drawCounts.empty())
+	{
+		return 0;
+	}
+
+	GLuint triangles = 0;
+	for (size_t i = 0; i < drawCounts.size(); i++)
+	{
+		triangles += drawCounts[i] / 3;
+	}
+
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-	glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+	glMultiDrawElements(GL_TRIANGLES, &drawCounts[0], indexType, &drawOffsets[0], drawCounts.size());
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
+
+	return triangles;
 }
 
-void Mesh::ClearMesh() 
+void Mesh::RenderMesh(GLuint lod)
 {
-	if (IBO != 0)
-	{
-		glDeleteBuffers(1, &IBO);
-		IBO = 0;
-	}
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	glDrawElements(GL_TRIANGLES, lods[lod].indexCount, indexType, (void*)(GetIndexSize() * lods[lod].indexOffset));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
 
-	if (VBO != 0)
+void Mesh::RenderRange(GLuint indexOffset, GLsizei indexCount)
+{
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	glDrawElements(GL_TRIANGLES, indexCount, indexType, (void*)(GetIndexSize() * indexOffset));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+void Mesh::SetInstanceAttribute(GLuint location, GLuint buffer, GLint components)
+{
+	glBindVertexArray(VAO);
+
+	if (buffer)
 	{
-		glDeleteBuffers(1, &VBO);
-		VBO = 0;
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glVertexAttribIPointer(location, components, GL_INT, 0, 0);
+		glVertexAttribDivisor(location, 1);
+		glEnableVertexAttribArray(location);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	else {
+		glDisableVertexAttribArray(location);
 	}
 
+	glBindVertexArray(0);
+}
+
+void Mesh::RenderIndirect(GLintptr commandOffset, GLsizei drawCount)
+{
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)commandOffset, drawCount, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+void Mesh::RenderIndirect(GLintptr commandOffset, GLintptr drawCountOffset, GLsizei maxDrawCount)
+{
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, indexType, (void*)commandOffset, drawCountOffset, maxDrawCount, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+void Mesh::ClearMesh() 
+{
+	// the cache deletes the buffers once no other mesh uses them
 	if (VAO != 0)
 	{
-		glDeleteVertexArrays(1, &VAO);
+		if (geometryShared)
+		{
+			GeometryCache::Release(geometryKey);
+		}
+		else {
+			glDeleteBuffers(1, &IBO);
+			glDeleteBuffers(1, &VBO);
+			glDeleteVertexArrays(1, &VAO);
+		}
+		geometryShared = false;
 		VAO = 0;
+		VBO = 0;
+		IBO = 0;
 	}
 
 	indexCount = 0;
+	lods.clear();
+	clusters.Clear();
+	indexBytes = 0;
+	vertexBytes = 0;
+	bounds = BoundingBox();
 }
 
 Mesh::~Mesh()
@@ -1,19 +1,82 @@
 #pragma once
 
+#include <vector>
+
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "BoundingBox.h"
+#include "ClusterSet.h"
+
+// Float: 32 bytes per vertex, positions as given.
+// Compact: 16 bytes, positions as unorm16 within a range the caller undoes in the model
+// matrix, half float UVs and 10:10:10:2 normals.
+enum VertexLayout { VERTEX_LAYOUT_FLOAT = 0, VERTEX_LAYOUT_COMPACT = 1 };
 
 class Mesh
 {
 public:
+	// a range of the index buffer and how far, in object units, it strays from level 0
+	struct LodLevel {
+		GLuint indexOffset;
+		GLsizei indexCount;
+		GLfloat error;
+	};
+
 	Mesh();
 
 	void CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices);
+	void CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices,
+					VertexLayout layout, const BoundingBox& positionRange);
+	void SetLods(const std::vector<LodLevel>& levels);
+	void BuildClusters(const std::vector<GLfloat>& vertices, const std::vector<unsigned int>& indices);
 	void RenderMesh();
+	void RenderMesh(GLuint lod);
+	GLuint RenderMesh(GLuint lod, const ClusterView* view);
+	void RenderRange(GLuint indexOffset, GLsizei indexCount);
+
+	// DrawElementsIndirectCommands read from the bound GL_DRAW_INDIRECT_BUFFER; with a
+	// GL_PARAMETER_BUFFER_ARB bound, drawCountOffset gives the number of commands instead
+	void RenderIndirect(GLintptr commandOffset, GLsizei drawCount);
+	void RenderIndirect(GLintptr commandOffset, GLintptr drawCountOffset, GLsizei maxDrawCount);
+
+	// feeds an integer attribute per instance from buffer, which indirect draws index with their
+	// baseInstance; buffer 0 turns it off so the attribute's current value is read again
+	void SetInstanceAttribute(GLuint location, GLuint buffer, GLint components);
 	void ClearMesh();
 
+	GLuint SelectLod(GLfloat pixelsPerUnit, GLfloat maxPixelError);
+	GLuint GetLodCount() { return lods.size(); }
+	GLsizei GetIndexCount(GLuint lod) { return lods[lod].indexCount; }
+
+	const BoundingBox& GetBounds() { return bounds; }
+
+	VertexLayout GetVertexLayout() { return vertexLayout; }
+	GLuint GetVertexSize() { return vertexLayout == VERTEX_LAYOUT_COMPACT ? 16 : sizeof(GLfloat) * 8; }
+	GLuint GetVertexBytes() { return vertexBytes; }
+	GLuint GetIndexSize() { return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+	GLuint GetIndexBytes() { return indexBytes; }
+
 	~Mesh();
 
 private:
 	GLuint VAO, VBO, IBO;
 	GLsizei indexCount;
+	GLenum indexType;
+	GLuint indexBytes;
+
+	std::vector<LodLevel> lods;
+
+	// level 0 only, coarser levels are cheap enough to draw whole
+	ClusterSet clusters;
+	std::vector<GLsizei> drawCounts;
+	std::vector<const void*> drawOffsets;
+
+	VertexLayout vertexLayout;
+	GLuint vertexBytes;
+
+	unsigned long long geometryKey;
+	bool geometryShared;
+
+	BoundingBox bounds;
 };
@@ -0,0 +1,328 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+// Forsyth's "linear-speed vertex cache optimisation" scoring constants
+static const int FORSYTH_CACHE_SIZE = 32;
+static const GLfloat CACHE_DECAY_POWER = 1.5f;
+static const GLfloat LAST_TRIANGLE_SCORE = 0.75f;
+static const GLfloat VALENCE_BOOST_SCALE = 2.0f;
+static const GLfloat VALENCE_BOOST_POWER = 0.5f;
+
+// cache size used to find hard boundaries between clusters for the overdraw pass
+static const unsigned int OVERDRAW_CACHE_SIZE = 16;
+
+static GLfloat CalcVertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+	if (remainingTriangles == 0)
+	{
+		return -1.0f;
+	}
+
+	GLfloat score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+		{
+			// the triangle just emitted; don't favour reusing it straight away
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else {
+			GLfloat scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	// vertices with few triangles left are finished off first so they can leave the cache
+	score += VALENCE_BOOST_SCALE * powf((GLfloat)remainingTriangles, -VALENCE_BOOST_POWER);
+
+	return score;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// vertex -> triangle adjacency, packed into one array
+	std::vector<unsigned int> triangleCounts(vertexCount, 0);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		triangleCounts[indices[i]]++;
+	}
+
+	std::vector<unsigned int> triangleOffsets(vertexCount, 0);
+	for (unsigned int v = 1; v < vertexCount; v++)
+	{
+		triangleOffsets[v] = triangleOffsets[v - 1] + triangleCounts[v - 1];
+	}
+
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (size_t k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[t * 3 + k];
+			adjacency[triangleOffsets[v] + remaining[v]++] = t;
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<GLfloat> vertexScore(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		vertexScore[v] = CalcVertexScore(-1, remaining[v]);
+	}
+
+	std::vector<GLfloat> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+	}
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+
+	std::vector<unsigned int> cache, newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	size_t scanCursor = 0;
+	int bestTriangle = -1;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// nothing good around the cache: restart from the next unused triangle
+		if (bestTriangle < 0)
+		{
+			while (emitted[scanCursor])
+			{
+				scanCursor++;
+			}
+			bestTriangle = scanCursor;
+		}
+
+		unsigned int tri[3] = { indices[bestTriangle * 3], indices[bestTriangle * 3 + 1], indices[bestTriangle * 3 + 2] };
+		emitted[bestTriangle] = true;
+		result.insert(result.end(), { tri[0], tri[1], tri[2] });
+
+		// drop the triangle from its vertices' live adjacency lists
+		for (size_t k = 0; k < 3; k++)
+		{
+			unsigned int v = tri[k];
+			unsigned int* list = &adjacency[triangleOffsets[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				if (list[j] == (unsigned int)bestTriangle)
+				{
+					list[j] = list[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// the new triangle goes to the front of the LRU cache
+		newCache.assign(tri, tri + 3);
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+			{
+				newCache.push_back(v);
+			}
+		}
+
+		for (size_t i = 0; i < newCache.size(); i++)
+		{
+			unsigned int v = newCache[i];
+			cachePosition[v] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+			vertexScore[v] = CalcVertexScore(cachePosition[v], remaining[v]);
+		}
+
+		if (newCache.size() > FORSYTH_CACHE_SIZE)
+		{
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		}
+		cache.swap(newCache);
+
+		// rescore the triangles touching the cache and pick the best one
+		bestTriangle = -1;
+		GLfloat bestScore = -1.0f;
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			unsigned int v = cache[i];
+			const unsigned int* list = &adjacency[triangleOffsets[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				unsigned int t = list[j];
+				triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<GLfloat>& vertices,
+									unsigned int vertexLength)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+	{
+		return;
+	}
+
+	unsigned int vertexCount = vertices.size() / vertexLength;
+
+	// split the cache-ordered list into clusters at hard boundaries, where a triangle
+	// misses on all three vertices; reordering whole clusters keeps the cache efficiency
+	std::vector<size_t> clusterStarts;
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	unsigned int time = OVERDRAW_CACHE_SIZE + 1;
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		unsigned int misses = 0;
+		for (size_t k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[t * 3 + k];
+			if (time - cacheTime[v] > OVERDRAW_CACHE_SIZE)
+			{
+				cacheTime[v] = time++;
+				misses++;
+			}
+		}
+
+		if (t == 0 || misses == 3)
+		{
+			clusterStarts.push_back(t);
+		}
+	}
+	clusterStarts.push_back(triangleCount);
+
+	glm::vec3 meshCentroid(0.0f, 0.0f, 0.0f);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		meshCentroid += glm::vec3(vertices[v * vertexLength], vertices[v * vertexLength + 1], vertices[v * vertexLength + 2]);
+	}
+	meshCentroid /= (GLfloat)vertexCount;
+
+	// clusters facing away from the mesh centre are most likely to occlude the rest, draw them first
+	size_t clusterCount = clusterStarts.size() - 1;
+	std::vector<GLfloat> clusterSortKey(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		glm::vec3 centroid(0.0f, 0.0f, 0.0f);
+		glm::vec3 normal(0.0f, 0.0f, 0.0f);
+		GLfloat area = 0.0f;
+
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			const GLfloat* p0 = &vertices[indices[t * 3] * vertexLength];
+			const GLfloat* p1 = &vertices[indices[t * 3 + 1] * vertexLength];
+			const GLfloat* p2 = &vertices[indices[t * 3 + 2] * vertexLength];
+
+			glm::vec3 v0(p0[0], p0[1], p0[2]), v1(p1[0], p1[1], p1[2]), v2(p2[0], p2[1], p2[2]);
+			glm::vec3 faceNormal = glm::cross(v1 - v0, v2 - v0);
+			GLfloat faceArea = glm::length(faceNormal);
+
+			centroid += (v0 + v1 + v2) * (faceArea / 3.0f);
+			normal += faceNormal;
+			area += faceArea;
+		}
+
+		if (area > 0.0f)
+		{
+			centroid /= area;
+		}
+
+		GLfloat normalLength = glm::length(normal);
+		clusterSortKey[c] = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+	}
+
+	std::vector<size_t> clusterOrder(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		clusterOrder[c] = c;
+	}
+
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&clusterSortKey](size_t a, size_t b) {
+		return clusterSortKey[a] > clusterSortKey[b];
+	});
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t i = 0; i < clusterCount; i++)
+	{
+		size_t c = clusterOrder[i];
+		result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+	}
+
+	indices.swap(result);
+}
+
+unsigned int MeshOptimizer::OptimizeVertexFetch(std::vector<GLfloat>& vertices, std::vector<unsigned int>& indices,
+											unsigned int vertexLength)
+{
+	unsigned int vertexCount = vertices.size() / vertexLength;
+
+	// vertices are laid out in the order the index buffer first touches them; unused ones are dropped
+	std::vector<unsigned int> remap(vertexCount, ~0u);
+	std::vector<GLfloat> result;
+	result.reserve(vertices.size());
+
+	unsigned int nextVertex = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if (remap[v] == ~0u)
+		{
+			remap[v] = nextVertex++;
+			result.insert(result.end(), vertices.begin() + v * vertexLength, vertices.begin() + (v + 1) * vertexLength);
+		}
+		indices[i] = remap[v];
+	}
+
+	vertices.swap(result);
+	return nextVertex;
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount,
+															unsigned int cacheSize)
+{
+	CacheStats stats;
+	stats.triangles = indices.size() / 3;
+	stats.vertices = vertexCount;
+	stats.misses = 0;
+
+	// FIFO cache, which is how most hardware behaves
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if (time - cacheTime[v] > cacheSize)
+		{
+			cacheTime[v] = time++;
+			stats.misses++;
+		}
+	}
+
+	return stats;
+}
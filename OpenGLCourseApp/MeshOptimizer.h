@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+// Import-time reordering of triangle lists for the GPU's post-transform vertex cache,
+// for less overdraw, and of vertices for fetch locality. Vertices are interleaved
+// GLfloats with the position in the first three components.
+class MeshOptimizer
+{
+public:
+	struct CacheStats {
+		unsigned int triangles;
+		unsigned int vertices;
+		unsigned int misses;
+
+		// average cache miss ratio: transformed vertices per triangle, 0.5 is ideal
+		GLfloat GetACMR() { return triangles ? (GLfloat)misses / triangles : 0.0f; }
+		// average transform to vertex ratio: 1.0 is ideal
+		GLfloat GetATVR() { return vertices ? (GLfloat)misses / vertices : 0.0f; }
+	};
+
+	static void OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount);
+
+	static void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<GLfloat>& vertices,
+								unsigned int vertexLength);
+
+	static unsigned int OptimizeVertexFetch(std::vector<GLfloat>& vertices, std::vector<unsigned int>& indices,
+										unsigned int vertexLength);
+
+	static CacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount,
+										unsigned int cacheSize);
+};
+
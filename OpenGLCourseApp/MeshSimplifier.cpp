@@ -0,0 +1,347 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+// open edges get a perpendicular plane this many times stronger than a face
+static const double BORDER_WEIGHT = 10.0;
+// scales uv and normal differences, relative to the mesh radius, into the collapse cost
+static const double ATTRIBUTE_WEIGHT = 0.01;
+// a collapse may not turn a face further than this (cosine)
+static const GLfloat MIN_FACE_COSINE = 0.2f;
+
+struct Quadric
+{
+	double a2, ab, ac, ad;
+	double b2, bc, bd;
+	double c2, cd;
+	double d2;
+	double weight;
+
+	Quadric()
+	{
+		a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = weight = 0.0;
+	}
+
+	// squared distance to the plane ax + by + cz + d = 0, times weight
+	void AddPlane(double a, double b, double c, double d, double w)
+	{
+		a2 += a * a * w; ab += a * b * w; ac += a * c * w; ad += a * d * w;
+		b2 += b * b * w; bc += b * c * w; bd += b * d * w;
+		c2 += c * c * w; cd += c * d * w;
+		d2 += d * d * w;
+		weight += w;
+	}
+
+	void Add(const Quadric& q)
+	{
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+		weight += q.weight;
+	}
+
+	// weighted mean squared distance of p to the accumulated planes
+	double Evaluate(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double error = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+			+ b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+			+ c2 * z * z + 2.0 * cd * z
+			+ d2;
+
+		return weight > 0.0 ? fabs(error) / weight : 0.0;
+	}
+};
+
+struct Collapse
+{
+	double cost;
+	double error;
+	unsigned int from;
+	unsigned int to;
+
+	bool operator<(const Collapse& other) const { return cost < other.cost; }
+};
+
+static glm::vec3 GetPosition(const std::vector<GLfloat>& vertices, unsigned int vertexLength, unsigned int v)
+{
+	return glm::vec3(vertices[v * vertexLength], vertices[v * vertexLength + 1], vertices[v * vertexLength + 2]);
+}
+
+static unsigned long long EdgeKey(unsigned int a, unsigned int b)
+{
+	return a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+}
+
+GLfloat MeshSimplifier::Simplify(std::vector<unsigned int>& indices, const std::vector<GLfloat>& vertices,
+								unsigned int vertexLength, size_t targetIndexCount)
+{
+	unsigned int vertexCount = vertices.size() / vertexLength;
+	if (indices.size() <= targetIndexCount || vertexCount == 0)
+	{
+		return 0.0f;
+	}
+
+	glm::vec3 minCorner = GetPosition(vertices, vertexLength, 0), maxCorner = minCorner;
+	for (unsigned int v = 1; v < vertexCount; v++)
+	{
+		glm::vec3 p = GetPosition(vertices, vertexLength, v);
+		minCorner = glm::min(minCorner, p);
+		maxCorner = glm::max(maxCorner, p);
+	}
+	double attributeScale = ATTRIBUTE_WEIGHT * glm::length(maxCorner - minCorner) * 0.5;
+	attributeScale *= attributeScale;
+
+	// open edges, counted once per triangle that uses them
+	std::unordered_map<unsigned long long, unsigned int> edgeUse;
+	edgeUse.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (size_t k = 0; k < 3; k++)
+		{
+			edgeUse[EdgeKey(indices[i + k], indices[i + (k + 1) % 3])]++;
+		}
+	}
+
+	std::vector<bool> border(vertexCount, false);
+	std::vector<Quadric> quadrics(vertexCount);
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		glm::vec3 p[3];
+		for (size_t k = 0; k < 3; k++)
+		{
+			p[k] = GetPosition(vertices, vertexLength, indices[i + k]);
+		}
+
+		glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+		GLfloat area = glm::length(normal);
+		if (area <= 0.0f)
+		{
+			continue;
+		}
+		normal /= area;
+
+		Quadric face;
+		face.AddPlane(normal.x, normal.y, normal.z, -glm::dot(normal, p[0]), area);
+		for (size_t k = 0; k < 3; k++)
+		{
+			quadrics[indices[i + k]].Add(face);
+		}
+
+		// keep open edges where they are with a plane through the edge, perpendicular to the face
+		for (size_t k = 0; k < 3; k++)
+		{
+			unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+			if (edgeUse[EdgeKey(a, b)] != 1)
+			{
+				continue;
+			}
+
+			border[a] = border[b] = true;
+
+			glm::vec3 edge = p[(k + 1) % 3] - p[k];
+			GLfloat length = glm::length(edge);
+			if (length <= 0.0f)
+			{
+				continue;
+			}
+
+			glm::vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+			Quadric edgeQuadric;
+			edgeQuadric.AddPlane(edgeNormal.x, edgeNormal.y, edgeNormal.z, -glm::dot(edgeNormal, p[k]),
+								BORDER_WEIGHT * length * length);
+			quadrics[a].Add(edgeQuadric);
+			quadrics[b].Add(edgeQuadric);
+		}
+	}
+
+	double maxError = 0.0;
+
+	std::vector<unsigned int> triangleCounts(vertexCount), triangleOffsets(vertexCount), adjacency;
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<bool> locked(vertexCount);
+	std::vector<Collapse> collapses;
+
+	while (indices.size() > targetIndexCount)
+	{
+		// vertex -> triangle adjacency of the current index list
+		std::fill(triangleCounts.begin(), triangleCounts.end(), 0);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			triangleCounts[indices[i]]++;
+		}
+
+		unsigned int offset = 0;
+		for (unsigned int v = 0; v < vertexCount; v++)
+		{
+			triangleOffsets[v] = offset;
+			offset += triangleCounts[v];
+			triangleCounts[v] = 0;
+		}
+
+		adjacency.resize(indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			unsigned int v = indices[i];
+			adjacency[triangleOffsets[v] + triangleCounts[v]++] = i / 3;
+		}
+
+		// price up every edge in its cheaper legal direction
+		edgeUse.clear();
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				edgeUse[EdgeKey(indices[i + k], indices[i + (k + 1) % 3])]++;
+			}
+		}
+
+		collapses.clear();
+		for (auto it = edgeUse.begin(); it != edgeUse.end(); ++it)
+		{
+			unsigned int a = (unsigned int)(it->first >> 32), b = (unsigned int)(it->first & 0xFFFFFFFF);
+			bool borderEdge = it->second == 1;
+
+			Collapse best;
+			best.cost = -1.0;
+
+			for (size_t direction = 0; direction < 2; direction++)
+			{
+				unsigned int from = direction ? b : a, to = direction ? a : b;
+
+				// border vertices may only slide along the border
+				if (border[from] && !(border[to] && borderEdge))
+				{
+					continue;
+				}
+
+				glm::vec3 target = GetPosition(vertices, vertexLength, to);
+
+				Quadric merged = quadrics[from];
+				merged.Add(quadrics[to]);
+				double error = merged.Evaluate(target);
+
+				double attributeError = 0.0;
+				for (unsigned int c = 3; c < vertexLength; c++)
+				{
+					double d = vertices[from * vertexLength + c] - vertices[to * vertexLength + c];
+					attributeError += d * d;
+				}
+
+				double cost = error + attributeError * attributeScale;
+				if (best.cost < 0.0 || cost < best.cost)
+				{
+					best.cost = cost;
+					best.error = error;
+					best.from = from;
+					best.to = to;
+				}
+			}
+
+			if (best.cost >= 0.0)
+			{
+				collapses.push_back(best);
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end());
+
+		for (unsigned int v = 0; v < vertexCount; v++)
+		{
+			remap[v] = v;
+		}
+		std::fill(locked.begin(), locked.end(), false);
+
+		// each interior collapse removes two triangles; stop once the target would be reached
+		size_t removable = (indices.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		size_t applied = 0;
+
+		for (size_t i = 0; i < collapses.size() && removed < removable; i++)
+		{
+			const Collapse& collapse = collapses[i];
+			if (locked[collapse.from] || locked[collapse.to])
+			{
+				continue;
+			}
+
+			glm::vec3 target = GetPosition(vertices, vertexLength, collapse.to);
+
+			// reject collapses that would fold a surrounding triangle over
+			bool flips = false;
+			size_t collapsedTriangles = 0;
+			for (unsigned int j = 0; j < triangleCounts[collapse.from] && !flips; j++)
+			{
+				unsigned int t = adjacency[triangleOffsets[collapse.from] + j];
+				unsigned int tri[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+				{
+					collapsedTriangles++;
+					continue;
+				}
+
+				glm::vec3 p[3], q[3];
+				for (size_t k = 0; k < 3; k++)
+				{
+					p[k] = GetPosition(vertices, vertexLength, tri[k]);
+					q[k] = tri[k] == collapse.from ? target : p[k];
+				}
+
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				GLfloat lengths = glm::length(before) * glm::length(after);
+
+				flips = lengths <= 0.0f || glm::dot(before, after) < MIN_FACE_COSINE * lengths;
+			}
+
+			if (flips)
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.error);
+
+			// the one-ring of the removed vertex changed, leave it for the next pass
+			locked[collapse.to] = true;
+			for (unsigned int j = 0; j < triangleCounts[collapse.from]; j++)
+			{
+				unsigned int t = adjacency[triangleOffsets[collapse.from] + j];
+				locked[indices[t * 3]] = locked[indices[t * 3 + 1]] = locked[indices[t * 3 + 2]] = true;
+			}
+
+			removed += collapsedTriangles;
+			applied++;
+		}
+
+		if (applied == 0)
+		{
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+			if (a == b || b == c || a == c)
+			{
+				continue;
+			}
+
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+	}
+
+	return (GLfloat)sqrt(maxError);
+}
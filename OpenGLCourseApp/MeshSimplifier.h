@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+// Quadric error metric simplification by half-edge collapse: vertices only ever merge into
+// existing ones, so every level of detail indexes the original vertex buffer. Open edges,
+// which includes UV and normal seams, are held in place and attribute differences make a
+// collapse more expensive. Vertices are interleaved GLfloats, position then uv then normal.
+class MeshSimplifier
+{
+public:
+	// Shrinks indices towards targetIndexCount, returns the geometric error in object units
+	static GLfloat Simplify(std::vector<unsigned int>& indices, const std::vector<GLfloat>& vertices,
+							unsigned int vertexLength, size_t targetIndexCount);
+};
+
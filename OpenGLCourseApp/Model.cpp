@@ -1,9 +1,19 @@
 #include "pch.h"
 #include "Model.h"
 
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+
+#include "ObjLoader.h"
+
+// half float UVs beyond this lose sub-texel precision on a 1024 texture
+static const GLfloat MAX_COMPACT_UV = 2.0f;
+
 
 Model::Model()
 {
+	vertexLayout = VERTEX_LAYOUT_FLOAT;
 }
 
 void Model::RenderModel()
@@ -21,20 +31,301 @@ void Model::RenderModel()
 	}
 }
 
+GLuint Model::RenderModel(GLfloat pixelsPerUnit, GLfloat maxPixelError, const ClusterView* view)
+{
+	GLuint triangles = 0;
+
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		unsigned int materialIndex = meshToTex[i];
+
+		if (materialIndex < textureList.size() && textureList[materialIndex])
+		{
+			textureList[materialIndex]->UseTexture();
+		}
+
+		GLuint lod = meshList[i]->SelectLod(pixelsPerUnit, maxPixelError);
+		triangles += meshList[i]->RenderMesh(lod, view);
+	}
+
+	return triangles;
+}
+
 void Model::LoadModel(const std::string & fileName)
+{
+	cacheStatsBefore = cacheStatsAfter = { 0, 0, 0 };
+	for (size_t i = 0; i < MAX_MESH_LODS; i++)
+	{
+		lodTriangles[i] = 0;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	// OBJ files go through the streaming loader, everything else and anything it rejects through Assimp
+	const char* loader = "ObjLoader";
+	bool loaded = false;
+	if (fileName.size() > 4 && (fileName.compare(fileName.size() - 4, 4, ".obj") == 0 || fileName.compare(fileName.size() - 4, 4, ".OBJ") == 0))
+	{
+		loaded = LoadObj(fileName);
+	}
+
+	if (!loaded)
+	{
+		ClearModel();
+		loader = "Assimp";
+		loaded = LoadAssimp(fileName);
+	}
+
+	if (!loaded)
+	{
+		return;
+	}
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Model (%s) loaded by %s in %.1f ms\n", fileName.c_str(), loader, milliseconds);
+
+	start = std::chrono::steady_clock::now();
+	BuildTriangleBvh();
+	milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Model (%s) triangle BVH: %u triangles, %u nodes in %.1f ms\n", fileName.c_str(),
+		(GLuint)bvhTriangles.size(), triangleBvh.GetNodeCount(), milliseconds);
+
+	GLuint vertexBytes = 0, floatBytes = 0, indexBytes = 0, intIndexBytes = 0;
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		vertexBytes += meshList[i]->GetVertexBytes();
+		floatBytes += meshList[i]->GetVertexBytes() / meshList[i]->GetVertexSize() * sizeof(GLfloat) * 8;
+		indexBytes += meshList[i]->GetIndexBytes();
+		intIndexBytes += meshList[i]->GetIndexBytes() / meshList[i]->GetIndexSize() * sizeof(GLuint);
+	}
+	printf("Model (%s) vertex data: %s, %u bytes per vertex, %u KB instead of %u KB\n", fileName.c_str(),
+		vertexLayout == VERTEX_LAYOUT_COMPACT ? "compact" : "float",
+		vertexLayout == VERTEX_LAYOUT_COMPACT ? 16 : (GLuint)sizeof(GLfloat) * 8, vertexBytes / 1024, floatBytes / 1024);
+	printf("Model (%s) index data: %u meshes, %u KB instead of %u KB\n", fileName.c_str(),
+		(GLuint)meshList.size(), indexBytes / 1024, intIndexBytes / 1024);
+
+	printf("Model (%s) vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", fileName.c_str(),
+		cacheStatsBefore.GetACMR(), cacheStatsAfter.GetACMR(), cacheStatsBefore.GetATVR(), cacheStatsAfter.GetATVR());
+
+	printf("Model (%s) triangles per LOD:", fileName.c_str());
+	for (size_t i = 0; i < MAX_MESH_LODS; i++)
+	{
+		printf(" %u", lodTriangles[i]);
+	}
+	printf("\n");
+}
+
+bool Model::LoadObj(const std::string& fileName)
+{
+#ifdef _DEBUG
+	static bool chunksChecked = false;
+	if (!chunksChecked)
+	{
+		chunksChecked = true;
+		if (!ObjLoader::CheckChunkBoundaries())
+		{
+			printf("ObjLoader: parsing in chunks differs from parsing whole\n");
+		}
+	}
+#endif
+
+	ObjLoader loader;
+	if (!loader.Load(fileName))
+	{
+		return false;
+	}
+
+	std::vector<ObjLoader::Group>& groups = loader.GetGroups();
+
+	BoundingBox sceneBounds;
+	GLfloat maxUV = 0.0f;
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		const std::vector<GLfloat>& vertices = groups[i].vertices;
+		for (size_t j = 0; j < vertices.size(); j += 8)
+		{
+			sceneBounds.Expand(glm::vec3(vertices[j], vertices[j + 1], vertices[j + 2]));
+			maxUV = glm::max(maxUV, glm::max(fabsf(vertices[j + 3]), fabsf(vertices[j + 4])));
+		}
+	}
+	SetVertexStorage(sceneBounds, maxUV);
+
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		LoadMeshData(groups[i].vertices, groups[i].indices, groups[i].materialIndex);
+
+		// release each group as soon as it is on the GPU to keep the peak down
+		std::vector<GLfloat>().swap(groups[i].vertices);
+		std::vector<unsigned int>().swap(groups[i].indices);
+	}
+
+	const std::vector<ObjLoader::Material>& materials = loader.GetMaterials();
+	textureList.resize(materials.size());
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		textureList[i] = LoadDiffuseTexture(materials[i].diffuseTexture);
+	}
+
+	return true;
+}
+
+bool Model::LoadAssimp(const std::string& fileName)
 {
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices);
 
 	if (!scene)
 	{
-		printf("Model (%s) failed to load: %s", fileName, importer.GetErrorString());
-		return;
+		printf("Model (%s) failed to load: %s", fileName.c_str(), importer.GetErrorString());
+		return false;
 	}
 
+	BoundingBox sceneBounds;
+	GLfloat maxUV = 0.0f;
+	for (size_t i = 0; i < scene->mNumMeshes; i++)
+	{
+		aiMesh* mesh = scene->mMeshes[i];
+		for (size_t j = 0; j < mesh->mNumVertices; j++)
+		{
+			sceneBounds.Expand(glm::vec3(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z));
+
+			if (mesh->mTextureCoords[0])
+			{
+				maxUV = glm::max(maxUV, glm::max(fabsf(mesh->mTextureCoords[0][j].x), fabsf(mesh->mTextureCoords[0][j].y)));
+			}
+		}
+	}
+	SetVertexStorage(sceneBounds, maxUV);
+
 	LoadNode(scene->mRootNode, scene);
 
 	LoadMaterials(scene);
+
+	return true;
+}
+
+void Model::SetVertexStorage(const BoundingBox& sceneBounds, GLfloat maxUV)
+{
+	// one layout for the whole model: compact unless some UV needs float precision
+	vertexLayout = maxUV > MAX_COMPACT_UV ? VERTEX_LAYOUT_FLOAT : VERTEX_LAYOUT_COMPACT;
+
+	GLfloat rangeSize = glm::max(glm::max(sceneBounds.GetMax().x - sceneBounds.GetMin().x, sceneBounds.GetMax().y - sceneBounds.GetMin().y),
+								sceneBounds.GetMax().z - sceneBounds.GetMin().z);
+	positionRange = BoundingBox(sceneBounds.GetMin(), sceneBounds.GetMin() + glm::vec3(rangeSize, rangeSize, rangeSize));
+}
+
+void Model::BuildTriangleBvh()
+{
+	bvhTriangles.clear();
+	std::vector<BoundingBox> boxes;
+
+	for (size_t m = 0; m < meshIndices.size(); m++)
+	{
+		const std::vector<GLfloat>& vertices = meshVertices[m];
+		const std::vector<unsigned int>& indices = meshIndices[m];
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			BoundingBox box;
+			for (size_t k = 0; k < 3; k++)
+			{
+				const GLfloat* p = &vertices[indices[i + k] * 8];
+				box.Expand(glm::vec3(p[0], p[1], p[2]));
+			}
+
+			boxes.push_back(box);
+			bvhTriangles.push_back(std::make_pair((GLuint)m, (GLuint)i));
+		}
+	}
+
+	triangleBvh.Build(boxes);
+}
+
+bool Model::Raycast(glm::vec3 origin, glm::vec3 direction, GLfloat& distance)
+{
+	GLfloat nearest = FLT_MAX;
+
+	triangleBvh.Raycast(origin, direction, FLT_MAX, [&](GLuint primitive, GLfloat& maxDistance) {
+		const std::vector<GLfloat>& vertices = meshVertices[bvhTriangles[primitive].first];
+		const unsigned int* tri = &meshIndices[bvhTriangles[primitive].first][bvhTriangles[primitive].second];
+
+		glm::vec3 p0(vertices[tri[0] * 8], vertices[tri[0] * 8 + 1], vertices[tri[0] * 8 + 2]);
+		glm::vec3 p1(vertices[tri[1] * 8], vertices[tri[1] * 8 + 1], vertices[tri[1] * 8 + 2]);
+		glm::vec3 p2(vertices[tri[2] * 8], vertices[tri[2] * 8 + 1], vertices[tri[2] * 8 + 2]);
+
+		// Moller-Trumbore, both sides
+		glm::vec3 e1 = p1 - p0, e2 = p2 - p0;
+		glm::vec3 h = glm::cross(direction, e2);
+		GLfloat a = glm::dot(e1, h);
+		if (fabsf(a) < 1e-12f)
+		{
+			return;
+		}
+
+		GLfloat f = 1.0f / a;
+		glm::vec3 s = origin - p0;
+		GLfloat u = f * glm::dot(s, h);
+		if (u < 0.0f || u > 1.0f)
+		{
+			return;
+		}
+
+		glm::vec3 q = glm::cross(s, e1);
+		GLfloat v = f * glm::dot(direction, q);
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return;
+		}
+
+		GLfloat t = f * glm::dot(e2, q);
+		if (t > 0.0f && t < maxDistance)
+		{
+			maxDistance = t;
+			nearest = t;
+		}
+	});
+
+	if (nearest == FLT_MAX)
+	{
+		return false;
+	}
+
+	distance = nearest;
+	return true;
+}
+
+void Model::AddToBatch(StaticBatch* batch, glm::mat4 model, Material* material)
+{
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		unsigned int materialIndex = meshToTex[i];
+		Texture* texture = materialIndex < textureList.size() ? textureList[materialIndex] : nullptr;
+
+		batch->Add(&meshVertices[i][0], meshVertices[i].size(), &meshIndices[i][0], meshIndices[i].size(),
+				model, texture, material);
+	}
+}
+
+void Model::AddOccluder(OcclusionCuller* culler, glm::mat4 model)
+{
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		if (!meshIndices[i].empty())
+		{
+			culler->AddOccluder(&meshVertices[i][0], meshVertices[i].size(), 8, &meshIndices[i][0], meshIndices[i].size(), model);
+		}
+	}
+}
+
+glm::mat4 Model::GetVertexTransform()
+{
+	if (positionRange.IsEmpty())
+	{
+		return glm::mat4(1.0f);
+	}
+
+	glm::mat4 transform = glm::translate(glm::mat4(1.0f), positionRange.GetMin());
+	return glm::scale(transform, positionRange.GetMax() - positionRange.GetMin());
 }
 
 void Model::LoadNode(aiNode * node, const aiScene * scene)
@@ -77,10 +368,133 @@ void Model::LoadMesh(aiMesh * mesh, const aiScene * scene)
 		}
 	}
 
+	LoadMeshData(vertices, indices, mesh->mMaterialIndex);
+}
+
+void Model::LoadMeshData(std::vector<GLfloat>& vertices, std::vector<unsigned int>& indices, unsigned int materialIndex)
+{
+	unsigned int vertexCount = vertices.size() / 8;
+
+	if (indices.empty())
+	{
+		return;
+	}
+
+	if (vertexCount <= MAX_SHORT_INDEX_VERTICES)
+	{
+		LoadMeshPart(vertices, indices, materialIndex);
+		return;
+	}
+
+	// split into parts of at most MAX_SHORT_INDEX_VERTICES vertices so each can use 16-bit indices
+	std::vector<unsigned int> partRemap(vertexCount, ~0u);
+	std::vector<GLfloat> partVertices;
+	std::vector<unsigned int> partIndices, partUsed;
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		unsigned int newVertices = 0;
+		for (size_t k = 0; k < 3; k++)
+		{
+			if (partRemap[indices[i + k]] == ~0u)
+			{
+				newVertices++;
+			}
+		}
+
+		if (partUsed.size() + newVertices > MAX_SHORT_INDEX_VERTICES)
+		{
+			LoadMeshPart(partVertices, partIndices, materialIndex);
+
+			for (size_t j = 0; j < partUsed.size(); j++)
+			{
+				partRemap[partUsed[j]] = ~0u;
+			}
+			partVertices.clear();
+			partIndices.clear();
+			partUsed.clear();
+		}
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[i + k];
+			if (partRemap[v] == ~0u)
+			{
+				partRemap[v] = partUsed.size();
+				partUsed.push_back(v);
+				partVertices.insert(partVertices.end(), vertices.begin() + v * 8, vertices.begin() + (v + 1) * 8);
+			}
+			partIndices.push_back(partRemap[v]);
+		}
+	}
+
+	if (!partIndices.empty())
+	{
+		LoadMeshPart(partVertices, partIndices, materialIndex);
+	}
+}
+
+void Model::LoadMeshPart(std::vector<GLfloat>& vertices, std::vector<unsigned int>& indices, unsigned int materialIndex)
+{
+	unsigned int originalVertexCount = vertices.size() / 8;
+	MeshOptimizer::CacheStats before = MeshOptimizer::AnalyzeVertexCache(indices, originalVertexCount, MESH_CACHE_SIZE);
+
+	MeshOptimizer::OptimizeVertexCache(indices, originalVertexCount);
+	MeshOptimizer::OptimizeOverdraw(indices, vertices, 8);
+	unsigned int vertexCount = MeshOptimizer::OptimizeVertexFetch(vertices, indices, 8);
+
+	MeshOptimizer::CacheStats after = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount, MESH_CACHE_SIZE);
+
+	cacheStatsBefore.triangles += before.triangles;
+	cacheStatsBefore.vertices += before.vertices;
+	cacheStatsBefore.misses += before.misses;
+	cacheStatsAfter.triangles += after.triangles;
+	cacheStatsAfter.vertices += after.vertices;
+	cacheStatsAfter.misses += after.misses;
+
+	// every level indexes the same vertices, so they all go into one index buffer;
+	// meshes too small to simplify further repeat their last level
+	std::vector<Mesh::LodLevel> lods;
+	lods.push_back({ 0, (GLsizei)indices.size(), 0.0f });
+
+	std::vector<unsigned int> lodIndices = indices;
+	while (lods.size() < MAX_MESH_LODS)
+	{
+		size_t previousCount = lodIndices.size();
+		GLfloat error = MeshSimplifier::Simplify(lodIndices, vertices, 8, previousCount / 6 * 3);
+
+		if (lodIndices.size() >= previousCount * 9 / 10)
+		{
+			break;
+		}
+
+		MeshOptimizer::OptimizeVertexCache(lodIndices, vertexCount);
+
+		GLfloat previousError = lods.back().error;
+		lods.push_back({ (GLuint)indices.size(), (GLsizei)lodIndices.size(), error > previousError ? error : previousError });
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+	}
+
+	while (lods.size() < MAX_MESH_LODS)
+	{
+		lods.push_back(lods.back());
+	}
+
+	for (size_t i = 0; i < MAX_MESH_LODS; i++)
+	{
+		lodTriangles[i] += lods[i].indexCount / 3;
+	}
+
 	Mesh* newMesh = new Mesh();
-	newMesh->CreateMesh(&vertices[0], &indices[0], vertices.size(), indices.size());
+	newMesh->CreateMesh(&vertices[0], &indices[0], vertices.size(), indices.size(), vertexLayout, positionRange);
+	newMesh->SetLods(lods);
+	newMesh->BuildClusters(vertices, indices);
 	meshList.push_back(newMesh);
-	meshToTex.push_back(mesh->mMaterialIndex);
+	meshVertices.push_back(vertices);
+	meshIndices.push_back(std::vector<unsigned int>(indices.begin(), indices.begin() + lods[0].indexCount));
+	meshToTex.push_back(materialIndex);
+
+	bounds.Expand(newMesh->GetBounds());
 }
 
 void Model::LoadMaterials(const aiScene * scene)
@@ -91,35 +505,48 @@ void Model::LoadMaterials(const aiScene * scene)
 	{
 		aiMaterial* material = scene->mMaterials[i];
 
-		textureList[i] = nullptr;
-
+		std::string path;
 		if (material->GetTextureCount(aiTextureType_DIFFUSE))
 		{
-			aiString path;
-			if (material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS)
+			aiString texturePath;
+			if (material->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath) == AI_SUCCESS)
 			{
-				int idx = std::string(path.data).rfind("\\");
-				std::string filename = std::string(path.data).substr(idx + 1);
+				path = texturePath.data;
+			}
+		}
+
+		textureList[i] = LoadDiffuseTexture(path);
+	}
+}
 
-				std::string texPath = std::string("Textures/") + filename;
+Texture* Model::LoadDiffuseTexture(const std::string& path)
+{
+	Texture* texture = nullptr;
 
-				textureList[i] = new Texture(texPath.c_str());
+	if (!path.empty())
+	{
+		int idx = path.find_last_of("\\/");
+		std::string filename = path.substr(idx + 1);
 
-				if (!textureList[i]->LoadTexture())
-				{
-					printf("Failed to load texture at: %s\n", texPath);
-					delete textureList[i];
-					textureList[i] = nullptr;
-				}
-			}
-		}
-		
-		if (!textureList[i])
+		std::string texPath = std::string("Textures/") + filename;
+
+		texture = new Texture(texPath.c_str());
+
+		if (!texture->LoadTexture())
 		{
-			textureList[i] = new Texture("Textures/plain.png");
-			textureList[i]->LoadTextureA();
+			printf("Failed to load texture at: %s\n", texPath.c_str());
+			delete texture;
+			texture = nullptr;
 		}
 	}
+
+	if (!texture)
+	{
+		texture = new Texture("Textures/plain.png");
+		texture->LoadTextureA();
+	}
+
+	return texture;
 }
 
 void Model::ClearModel()
@@ -142,6 +569,15 @@ void Model::ClearModel()
 		}
 	}
 
+	meshList.clear();
+	meshToTex.clear();
+	meshVertices.clear();
+	meshIndices.clear();
+	triangleBvh.Clear();
+	bvhTriangles.clear();
+
+	bounds = BoundingBox();
+	positionRange = BoundingBox();
 }
 
 Model::~Model()
@@ -7,8 +7,17 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <glm/gtc/matrix_transform.hpp>
+
 #include "Mesh.h"
 #include "Texture.h"
+#include "Material.h"
+#include "StaticBatch.h"
+#include "BVH.h"
+#include "OcclusionCuller.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "CommonValues.h"
 
 class Model
 {
@@ -17,19 +26,60 @@ public:
 
 	void LoadModel(const std::string& fileName);
 	void RenderModel();
+	GLuint RenderModel(GLfloat pixelsPerUnit, GLfloat maxPixelError, const ClusterView* view);
+
+	// nearest hit along a ray in object space, against the full detail triangles
+	bool Raycast(glm::vec3 origin, glm::vec3 direction, GLfloat& distance);
+
+	// bakes the full detail meshes into a static batch, with the model's own textures
+	void AddToBatch(StaticBatch* batch, glm::mat4 model, Material* material);
+
+	// adds every mesh at full resolution as occluders; a simplified mesh can bulge past the
+	// original surface and hide objects that are really in front of it
+	void AddOccluder(OcclusionCuller* culler, glm::mat4 model);
 	void ClearModel();
 
+	const BoundingBox& GetBounds() { return bounds; }
+
+	// maps stored vertex positions back to object space, apply after the model matrix
+	glm::mat4 GetVertexTransform();
+
 	~Model();
 
 private:
 
+	bool LoadObj(const std::string& fileName);
+	bool LoadAssimp(const std::string& fileName);
+	void SetVertexStorage(const BoundingBox& sceneBounds, GLfloat maxUV);
+	void BuildTriangleBvh();
+
 	void LoadNode(aiNode* node, const aiScene* scene);
 	void LoadMesh(aiMesh* mesh, const aiScene* scene);
+	void LoadMeshData(std::vector<GLfloat>& vertices, std::vector<unsigned int>& indices, unsigned int materialIndex);
+	void LoadMeshPart(std::vector<GLfloat>& vertices, std::vector<unsigned int>& indices, unsigned int materialIndex);
 	void LoadMaterials(const aiScene* scene);
+	Texture* LoadDiffuseTexture(const std::string& path);
 
 	std::vector<Mesh*> meshList;
 	std::vector<Texture*> textureList;
 	std::vector<unsigned int> meshToTex;
 
+	// float vertices and level 0 indices of each mesh, kept for static batching
+	std::vector<std::vector<GLfloat>> meshVertices;
+	std::vector<std::vector<unsigned int>> meshIndices;
+
+	// over every level 0 triangle, each primitive being a (mesh, first index) pair
+	BVH triangleBvh;
+	std::vector<std::pair<GLuint, GLuint>> bvhTriangles;
+
+	BoundingBox bounds;
+
+	// a cube around the whole model, so the dequantisation is a uniform scale shared by all meshes
+	BoundingBox positionRange;
+	VertexLayout vertexLayout;
+
+	MeshOptimizer::CacheStats cacheStatsBefore, cacheStatsAfter;
+	unsigned int lodTriangles[MAX_MESH_LODS];
+
 };
 
@@ -0,0 +1,166 @@
+#include "pch.h"
+#include "NormalGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <xmmintrin.h>
+
+#include <glm/glm.hpp>
+
+// below this many triangles the thread start up costs more than it saves
+static const unsigned int MIN_PARALLEL_TRIANGLES = 65536;
+
+// Runs task(begin, end) over [0, count) split across the hardware threads
+template <typename Task>
+static void ParallelFor(unsigned int count, bool parallel, Task task)
+{
+	unsigned int threadCount = parallel ? std::max(1u, std::thread::hardware_concurrency()) : 1;
+	if (threadCount == 1 || count < threadCount)
+	{
+		task(0u, count);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	unsigned int chunk = (count + threadCount - 1) / threadCount;
+	for (unsigned int begin = 0; begin < count; begin += chunk)
+	{
+		threads.push_back(std::thread(task, begin, std::min(begin + chunk, count)));
+	}
+
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+}
+
+// CSR vertex -> triangle adjacency
+static void BuildAdjacency(unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount,
+						std::vector<unsigned int>& offsets, std::vector<unsigned int>& corners)
+{
+	offsets.assign(vertexCount + 1, 0);
+	for (unsigned int i = 0; i < indexCount; i++)
+	{
+		offsets[indices[i] + 1]++;
+	}
+
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+
+	// corners, not triangles, so per-corner weights can be looked up directly
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	corners.resize(indexCount);
+	for (unsigned int i = 0; i < indexCount; i++)
+	{
+		corners[fill[indices[i]]++] = i;
+	}
+}
+
+void NormalGenerator::GenerateNormals(GLfloat* vertices, unsigned int vertexCount, unsigned int vertexLength, unsigned int normalOffset,
+									const unsigned int* indices, unsigned int indexCount, NormalWeighting weighting)
+{
+	unsigned int triangleCount = indexCount / 3;
+	bool parallel = triangleCount >= MIN_PARALLEL_TRIANGLES;
+
+	// SoA positions
+	std::vector<GLfloat> px(vertexCount), py(vertexCount), pz(vertexCount);
+	ParallelFor(vertexCount, parallel, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int v = begin; v < end; v++)
+		{
+			px[v] = vertices[v * vertexLength];
+			py[v] = vertices[v * vertexLength + 1];
+			pz[v] = vertices[v * vertexLength + 2];
+		}
+	});
+
+	// face normals, length twice the triangle area, padded to a multiple of four
+	unsigned int paddedCount = (triangleCount + 3) & ~3u;
+	std::vector<GLfloat> nx(paddedCount), ny(paddedCount), nz(paddedCount);
+
+	ParallelFor(paddedCount / 4, parallel, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int block = begin; block < end; block++)
+		{
+			unsigned int t = block * 4;
+			unsigned int i0[4], i1[4], i2[4];
+			for (unsigned int k = 0; k < 4; k++)
+			{
+				// the padding repeats the last triangle
+				unsigned int tri = std::min(t + k, triangleCount - 1) * 3;
+				i0[k] = indices[tri];
+				i1[k] = indices[tri + 1];
+				i2[k] = indices[tri + 2];
+			}
+
+			__m128 x0 = _mm_setr_ps(px[i0[0]], px[i0[1]], px[i0[2]], px[i0[3]]);
+			__m128 y0 = _mm_setr_ps(py[i0[0]], py[i0[1]], py[i0[2]], py[i0[3]]);
+			__m128 z0 = _mm_setr_ps(pz[i0[0]], pz[i0[1]], pz[i0[2]], pz[i0[3]]);
+
+			__m128 e1x = _mm_sub_ps(_mm_setr_ps(px[i1[0]], px[i1[1]], px[i1[2]], px[i1[3]]), x0);
+			__m128 e1y = _mm_sub_ps(_mm_setr_ps(py[i1[0]], py[i1[1]], py[i1[2]], py[i1[3]]), y0);
+			__m128 e1z = _mm_sub_ps(_mm_setr_ps(pz[i1[0]], pz[i1[1]], pz[i1[2]], pz[i1[3]]), z0);
+
+			__m128 e2x = _mm_sub_ps(_mm_setr_ps(px[i2[0]], px[i2[1]], px[i2[2]], px[i2[3]]), x0);
+			__m128 e2y = _mm_sub_ps(_mm_setr_ps(py[i2[0]], py[i2[1]], py[i2[2]], py[i2[3]]), y0);
+			__m128 e2z = _mm_sub_ps(_mm_setr_ps(pz[i2[0]], pz[i2[1]], pz[i2[2]], pz[i2[3]]), z0);
+
+			_mm_storeu_ps(&nx[t], _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y)));
+			_mm_storeu_ps(&ny[t], _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z)));
+			_mm_storeu_ps(&nz[t], _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x)));
+		}
+	});
+
+	// per-corner weights: the corner angle over the face normal's length for angle weighting,
+	// so the sum ends up unit normal times angle; area weighting uses the raw normal as is
+	std::vector<GLfloat> cornerWeight(indexCount, 1.0f);
+	if (weighting == NORMAL_WEIGHT_ANGLE)
+	{
+		ParallelFor(triangleCount, parallel, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int t = begin; t < end; t++)
+			{
+				GLfloat length = sqrtf(nx[t] * nx[t] + ny[t] * ny[t] + nz[t] * nz[t]);
+				for (unsigned int k = 0; k < 3; k++)
+				{
+					unsigned int a = indices[t * 3 + k], b = indices[t * 3 + (k + 1) % 3], c = indices[t * 3 + (k + 2) % 3];
+					glm::vec3 ab(px[b] - px[a], py[b] - py[a], pz[b] - pz[a]);
+					glm::vec3 ac(px[c] - px[a], py[c] - py[a], pz[c] - pz[a]);
+
+					GLfloat lengths = glm::length(ab) * glm::length(ac);
+					GLfloat angle = lengths > 0.0f ? acosf(glm::clamp(glm::dot(ab, ac) / lengths, -1.0f, 1.0f)) : 0.0f;
+
+					cornerWeight[t * 3 + k] = length > 0.0f ? angle / length : 0.0f;
+				}
+			}
+		});
+	}
+
+	std::vector<unsigned int> offsets, corners;
+	BuildAdjacency(vertexCount, indices, indexCount, offsets, corners);
+
+	// each vertex owns its own output, so the gather needs no synchronisation
+	ParallelFor(vertexCount, parallel, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int v = begin; v < end; v++)
+		{
+			glm::vec3 sum(0.0f, 0.0f, 0.0f);
+			for (unsigned int j = offsets[v]; j < offsets[v + 1]; j++)
+			{
+				unsigned int corner = corners[j], t = corner / 3;
+				sum += glm::vec3(nx[t], ny[t], nz[t]) * cornerWeight[corner];
+			}
+
+			GLfloat length = glm::length(sum);
+			if (length > 0.0f)
+			{
+				sum /= length;
+			}
+
+			GLfloat* normal = &vertices[v * vertexLength + normalOffset];
+			normal[0] = sum.x;
+			normal[1] = sum.y;
+			normal[2] = sum.z;
+		}
+	});
+}
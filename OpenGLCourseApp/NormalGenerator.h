@@ -0,0 +1,18 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Area weighting lets large faces dominate, which suits smooth organic meshes; angle weighting
+// is independent of how the surface happens to be triangulated, which suits hard surfaces.
+enum NormalWeighting { NORMAL_WEIGHT_AREA = 0, NORMAL_WEIGHT_ANGLE = 1 };
+
+// Smooth vertex normals for indexed triangle lists in interleaved vertex arrays.
+// Face terms are computed four triangles at a time with SSE from SoA positions, then every
+// vertex gathers its faces through a vertex to face adjacency, so threads never share a write.
+class NormalGenerator
+{
+public:
+	static void GenerateNormals(GLfloat* vertices, unsigned int vertexCount, unsigned int vertexLength, unsigned int normalOffset,
+								const unsigned int* indices, unsigned int indexCount, NormalWeighting weighting);
+};
+
@@ -0,0 +1,660 @@
+#include "pch.h"
+#include "ObjLoader.h"
+
+#include <cstdio>
+#include <cmath>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "NormalGenerator.h"
+
+// chunks smaller than this are not worth a thread
+static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// negative (relative) references are stored with this bias until the chunk's base is known
+static const long long RELATIVE_REFERENCE = 1ll << 40;
+
+// Read only view of a whole file
+class MappedFile
+{
+public:
+	MappedFile()
+	{
+		data = nullptr;
+		size = 0;
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#endif
+	}
+
+	bool Open(const std::string& fileName)
+	{
+#ifdef _WIN32
+		file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(file, &fileSize);
+		size = (size_t)fileSize.QuadPart;
+		if (size == 0)
+		{
+			return false;
+		}
+
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+		{
+			return false;
+		}
+
+		data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int descriptor = open(fileName.c_str(), O_RDONLY);
+		if (descriptor < 0)
+		{
+			return false;
+		}
+
+		struct stat status;
+		fstat(descriptor, &status);
+		size = (size_t)status.st_size;
+
+		if (size > 0)
+		{
+			void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			data = view == MAP_FAILED ? nullptr : (const char*)view;
+		}
+		close(descriptor);
+#endif
+		return data != nullptr;
+	}
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (data) munmap((void*)data, size);
+#endif
+	}
+
+	const char* data;
+	size_t size;
+
+private:
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+static bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* SkipSpaces(const char* p, const char* end)
+{
+	while (p < end && IsSpace(*p))
+	{
+		p++;
+	}
+	return p;
+}
+
+static const char* ParseInt(const char* p, const char* end, long long& value)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	long long result = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		result = result * 10 + (*p - '0');
+		p++;
+	}
+
+	value = negative ? -result : result;
+	return p;
+}
+
+// Digits straight into an integer mantissa and one scale at the end; much faster than strtof,
+// within an ulp or so for the six to eight significant digits exporters write
+static const char* ParseFloat(const char* p, const char* end, GLfloat& value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	p = SkipSpaces(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits++; }
+		else { exponent++; }
+		p++;
+	}
+
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits++; exponent--; }
+			p++;
+		}
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		long long e = 0;
+		p = ParseInt(p + 1, end, e);
+		exponent += (int)e;
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0)
+	{
+		result = -exponent <= 22 ? result / powers[-exponent] : result * pow(10.0, exponent);
+	}
+	else if (exponent > 0) {
+		result = exponent <= 22 ? result * powers[exponent] : result * pow(10.0, exponent);
+	}
+
+	value = (GLfloat)(negative ? -result : result);
+	return p;
+}
+
+static bool StartsWith(const char* p, const char* end, const char* keyword)
+{
+	while (*keyword)
+	{
+		if (p >= end || *p != *keyword)
+		{
+			return false;
+		}
+		p++;
+		keyword++;
+	}
+
+	// the keyword must be a whole token
+	return p < end && IsSpace(*p);
+}
+
+static std::string RestOfLine(const char* p, const char* end)
+{
+	p = SkipSpaces(p, end);
+	const char* last = end;
+	while (last > p && IsSpace(last[-1]))
+	{
+		last--;
+	}
+	return std::string(p, last);
+}
+
+// What one chunk of the file contributes, before it knows how many elements came before it
+struct ObjChunk
+{
+	std::vector<GLfloat> positions, uvs, normals;
+
+	// position, uv, normal reference per triangle corner: 0-based, -1 for none, or biased relative
+	std::vector<long long> references;
+
+	// corner index where each usemtl takes effect
+	std::vector<std::pair<size_t, std::string>> materialSwitches;
+	std::vector<std::string> materialLibraries;
+};
+
+static long long ResolveReference(long long index, size_t localCount)
+{
+	if (index > 0)
+	{
+		return index - 1;
+	}
+	if (index < 0)
+	{
+		return RELATIVE_REFERENCE + (long long)localCount + index;
+	}
+	return -1;
+}
+
+static void ParseChunk(const char* p, const char* end, ObjChunk& chunk)
+{
+	std::vector<long long> polygon;
+
+	while (p < end)
+	{
+		const char* lineEnd = p;
+		while (lineEnd < end && *lineEnd != '\n')
+		{
+			lineEnd++;
+		}
+
+		p = SkipSpaces(p, lineEnd);
+
+		if (StartsWith(p, lineEnd, "v"))
+		{
+			GLfloat x, y, z;
+			const char* q = ParseFloat(p + 1, lineEnd, x);
+			q = ParseFloat(q, lineEnd, y);
+			ParseFloat(q, lineEnd, z);
+			chunk.positions.insert(chunk.positions.end(), { x, y, z });
+		}
+		else if (StartsWith(p, lineEnd, "vt")) {
+			GLfloat u, v;
+			const char* q = ParseFloat(p + 2, lineEnd, u);
+			ParseFloat(q, lineEnd, v);
+			chunk.uvs.insert(chunk.uvs.end(), { u, v });
+		}
+		else if (StartsWith(p, lineEnd, "vn")) {
+			GLfloat x, y, z;
+			const char* q = ParseFloat(p + 2, lineEnd, x);
+			q = ParseFloat(q, lineEnd, y);
+			ParseFloat(q, lineEnd, z);
+			chunk.normals.insert(chunk.normals.end(), { x, y, z });
+		}
+		else if (StartsWith(p, lineEnd, "f")) {
+			polygon.clear();
+
+			const char* q = SkipSpaces(p + 1, lineEnd);
+			while (q < lineEnd)
+			{
+				long long v = 0, vt = 0, vn = 0;
+				q = ParseInt(q, lineEnd, v);
+				if (q < lineEnd && *q == '/')
+				{
+					q++;
+					if (q < lineEnd && *q != '/')
+					{
+						q = ParseInt(q, lineEnd, vt);
+					}
+					if (q < lineEnd && *q == '/')
+					{
+						q = ParseInt(q + 1, lineEnd, vn);
+					}
+				}
+
+				polygon.push_back(ResolveReference(v, chunk.positions.size() / 3));
+				polygon.push_back(ResolveReference(vt, chunk.uvs.size() / 2));
+				polygon.push_back(ResolveReference(vn, chunk.normals.size() / 3));
+
+				while (q < lineEnd && !IsSpace(*q))
+				{
+					q++;
+				}
+				q = SkipSpaces(q, lineEnd);
+			}
+
+			// triangle fan over the polygon
+			size_t corners = polygon.size() / 3;
+			for (size_t i = 1; i + 1 < corners; i++)
+			{
+				chunk.references.insert(chunk.references.end(), polygon.begin(), polygon.begin() + 3);
+				chunk.references.insert(chunk.references.end(), polygon.begin() + i * 3, polygon.begin() + i * 3 + 6);
+			}
+		}
+		else if (StartsWith(p, lineEnd, "usemtl")) {
+			chunk.materialSwitches.push_back(std::make_pair(chunk.references.size() / 3, RestOfLine(p + 6, lineEnd)));
+		}
+		else if (StartsWith(p, lineEnd, "mtllib")) {
+			chunk.materialLibraries.push_back(RestOfLine(p + 6, lineEnd));
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+struct CornerKey
+{
+	long long position, uv, normal;
+
+	bool operator==(const CornerKey& other) const
+	{
+		return position == other.position && uv == other.uv && normal == other.normal;
+	}
+};
+
+struct CornerKeyHash
+{
+	size_t operator()(const CornerKey& key) const
+	{
+		unsigned long long hash = (unsigned long long)key.position * 0x9E3779B97F4A7C15ull;
+		hash ^= (unsigned long long)key.uv * 0xC2B2AE3D27D4EB4Full + (hash >> 29);
+		hash ^= (unsigned long long)key.normal * 0x165667B19E3779F9ull + (hash >> 32);
+		return (size_t)hash;
+	}
+};
+
+ObjLoader::ObjLoader()
+{
+}
+
+bool ObjLoader::Load(const std::string& fileName)
+{
+	groups.clear();
+	materials.clear();
+
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		printf("Failed to map %s\n", fileName.c_str());
+		return false;
+	}
+
+	// one chunk per thread
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	size_t chunkCount = file.size / MIN_CHUNK_BYTES + 1;
+	if (threadCount > 0 && chunkCount > threadCount)
+	{
+		chunkCount = threadCount;
+	}
+
+	// materials come from the libraries next to the OBJ
+	std::string directory;
+	size_t slash = fileName.find_last_of("/\\");
+	if (slash != std::string::npos)
+	{
+		directory = fileName.substr(0, slash + 1);
+	}
+
+	if (!Parse(file.data, file.size, directory, chunkCount))
+	{
+		printf("Invalid vertex reference in %s\n", fileName.c_str());
+		return false;
+	}
+
+	return !groups.empty();
+}
+
+bool ObjLoader::CheckChunkBoundaries()
+{
+	static const char obj[] =
+		"v 0 0 0\n"
+		"v 1 0 0\n"
+		"v 0 1 0\n"
+		"v 1 1 0\n"
+		"usemtl first\n"
+		"f 1 2 3\n"
+		"usemtl second\n"
+		"f 2 4 3\n"
+		"f 3 2 1\n"
+		"usemtl first\n"
+		"f -1 -2 -3\n";
+
+	ObjLoader whole, split;
+	whole.Parse(obj, sizeof(obj) - 1, "", 1);
+	split.Parse(obj, sizeof(obj) - 1, "", sizeof(obj));
+
+	if (whole.groups.size() != split.groups.size())
+	{
+		return false;
+	}
+
+	for (size_t g = 0; g < whole.groups.size(); g++)
+	{
+		if (whole.materials[whole.groups[g].materialIndex].name != split.materials[split.groups[g].materialIndex].name ||
+			whole.groups[g].vertices != split.groups[g].vertices ||
+			whole.groups[g].indices != split.groups[g].indices)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ObjLoader::Parse(const char* data, size_t size, const std::string& directory, size_t chunkCount)
+{
+	// line aligned chunks; with more chunks than lines some are empty
+	std::vector<const char*> chunkStarts;
+	const char* fileEnd = data + size;
+	const char* p = data;
+	for (size_t i = 0; i < chunkCount && p < fileEnd; i++)
+	{
+		chunkStarts.push_back(p);
+
+		p = data + size * (i + 1) / chunkCount;
+		while (p < fileEnd && p[-1] != '\n')
+		{
+			p++;
+		}
+	}
+	chunkStarts.push_back(fileEnd);
+
+	std::vector<ObjChunk> chunks(chunkStarts.size() - 1);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		threads.push_back(std::thread(ParseChunk, chunkStarts[i], chunkStarts[i + 1], std::ref(chunks[i])));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		for (size_t j = 0; j < chunks[i].materialLibraries.size(); j++)
+		{
+			LoadMaterialLibrary(directory + chunks[i].materialLibraries[j]);
+		}
+	}
+
+	// concatenate the elements so references become global
+	std::vector<GLfloat> positions, uvs, normals;
+	std::vector<size_t> positionBase(chunks.size()), uvBase(chunks.size()), normalBase(chunks.size());
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		positionBase[i] = positions.size() / 3;
+		uvBase[i] = uvs.size() / 2;
+		normalBase[i] = normals.size() / 3;
+
+		positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+		uvs.insert(uvs.end(), chunks[i].uvs.begin(), chunks[i].uvs.end());
+		normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+
+		chunks[i].positions.clear(); chunks[i].positions.shrink_to_fit();
+		chunks[i].uvs.clear(); chunks[i].uvs.shrink_to_fit();
+		chunks[i].normals.clear(); chunks[i].normals.shrink_to_fit();
+	}
+
+	// weld identical corners and sort triangles into groups by material
+	std::vector<int> groupOfMaterial;
+	std::vector<std::unordered_map<CornerKey, unsigned int, CornerKeyHash>> groupCorners;
+	std::vector<bool> groupNeedsNormals;
+	unsigned int material = FindMaterial("");
+
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		const ObjChunk& chunk = chunks[i];
+		size_t nextSwitch = 0;
+		size_t cornerCount = chunk.references.size() / 3;
+
+		for (size_t c = 0; c < cornerCount; c++)
+		{
+			while (nextSwitch < chunk.materialSwitches.size() && chunk.materialSwitches[nextSwitch].first == c)
+			{
+				material = FindMaterial(chunk.materialSwitches[nextSwitch].second);
+				nextSwitch++;
+			}
+
+			if (material >= groupOfMaterial.size())
+			{
+				groupOfMaterial.resize(material + 1, -1);
+			}
+			if (groupOfMaterial[material] < 0)
+			{
+				groupOfMaterial[material] = groups.size();
+				groups.push_back(Group());
+				groups.back().materialIndex = material;
+				groupCorners.push_back(std::unordered_map<CornerKey, unsigned int, CornerKeyHash>());
+				groupNeedsNormals.push_back(false);
+			}
+
+			int g = groupOfMaterial[material];
+			Group& group = groups[g];
+
+			CornerKey key;
+			const long long* reference = &chunk.references[c * 3];
+			key.position = reference[0] >= RELATIVE_REFERENCE / 2 ? reference[0] - RELATIVE_REFERENCE + positionBase[i] : reference[0];
+			key.uv = reference[1] >= RELATIVE_REFERENCE / 2 ? reference[1] - RELATIVE_REFERENCE + uvBase[i] : reference[1];
+			key.normal = reference[2] >= RELATIVE_REFERENCE / 2 ? reference[2] - RELATIVE_REFERENCE + normalBase[i] : reference[2];
+
+			if (key.position < 0 || key.position >= (long long)positions.size() / 3)
+			{
+				return false;
+			}
+			if (key.uv >= (long long)uvs.size() / 2) key.uv = -1;
+			if (key.normal >= (long long)normals.size() / 3) key.normal = -1;
+
+			auto found = groupCorners[g].find(key);
+			if (found != groupCorners[g].end())
+			{
+				group.indices.push_back(found->second);
+				continue;
+			}
+
+			unsigned int index = group.vertices.size() / 8;
+			groupCorners[g][key] = index;
+			group.indices.push_back(index);
+
+			const GLfloat* position = &positions[key.position * 3];
+			group.vertices.insert(group.vertices.end(), { position[0], position[1], position[2] });
+
+			if (key.uv >= 0)
+			{
+				group.vertices.insert(group.vertices.end(), { uvs[key.uv * 2], 1.0f - uvs[key.uv * 2 + 1] });
+			}
+			else {
+				group.vertices.insert(group.vertices.end(), { 0.0f, 0.0f });
+			}
+
+			if (key.normal >= 0)
+			{
+				const GLfloat* normal = &normals[key.normal * 3];
+				group.vertices.insert(group.vertices.end(), { -normal[0], -normal[1], -normal[2] });
+			}
+			else {
+				group.vertices.insert(group.vertices.end(), { 0.0f, 0.0f, 0.0f });
+				groupNeedsNormals[g] = true;
+			}
+		}
+
+		// a usemtl after the chunk's last face applies from the next chunk's first face
+		if (nextSwitch < chunk.materialSwitches.size())
+		{
+			material = FindMaterial(chunk.materialSwitches.back().second);
+		}
+	}
+
+	// files without normals get smooth ones, flipped inwards like the rest
+	for (size_t g = 0; g < groups.size(); g++)
+	{
+		if (!groupNeedsNormals[g])
+		{
+			continue;
+		}
+
+		Group& group = groups[g];
+		unsigned int vertexCount = group.vertices.size() / 8;
+		NormalGenerator::GenerateNormals(&group.vertices[0], vertexCount, 8, 5, &group.indices[0], group.indices.size(), NORMAL_WEIGHT_ANGLE);
+		for (unsigned int v = 0; v < vertexCount; v++)
+		{
+			for (int k = 5; k < 8; k++)
+			{
+				group.vertices[v * 8 + k] = -group.vertices[v * 8 + k];
+			}
+		}
+	}
+
+	return true;
+}
+
+bool ObjLoader::LoadMaterialLibrary(const std::string& fileName)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		printf("Failed to map material library %s\n", fileName.c_str());
+		return false;
+	}
+
+	const char* p = file.data;
+	const char* end = file.data + file.size;
+	Material* current = nullptr;
+
+	while (p < end)
+	{
+		const char* lineEnd = p;
+		while (lineEnd < end && *lineEnd != '\n')
+		{
+			lineEnd++;
+		}
+
+		p = SkipSpaces(p, lineEnd);
+
+		if (StartsWith(p, lineEnd, "newmtl"))
+		{
+			current = &materials[FindMaterial(RestOfLine(p + 6, lineEnd))];
+		}
+		else if (current && StartsWith(p, lineEnd, "map_Kd")) {
+			current->diffuseTexture = RestOfLine(p + 6, lineEnd);
+		}
+
+		p = lineEnd + 1;
+	}
+
+	return true;
+}
+
+unsigned int ObjLoader::FindMaterial(const std::string& name)
+{
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		if (materials[i].name == name)
+		{
+			return i;
+		}
+	}
+
+	Material material;
+	material.name = name;
+	materials.push_back(material);
+
+	return materials.size() - 1;
+}
+
+ObjLoader::~ObjLoader()
+{
+}
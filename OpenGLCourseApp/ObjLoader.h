@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <GL/glew.h>
+
+// Wavefront OBJ/MTL reader that goes straight to interleaved position, uv, normal vertices
+// with one indexed triangle list per material. The file is memory mapped and split into
+// line aligned chunks that are parsed in parallel; corners are then merged in file order.
+// UVs are flipped and normals point inwards to match what Model expects from Assimp.
+class ObjLoader
+{
+public:
+	struct Group {
+		unsigned int materialIndex;
+		std::vector<GLfloat> vertices;
+		std::vector<unsigned int> indices;
+	};
+
+	struct Material {
+		std::string name;
+		std::string diffuseTexture;
+	};
+
+	ObjLoader();
+
+	bool Load(const std::string& fileName);
+
+	// parses a small file split at every line, so each usemtl ends up on a chunk boundary,
+	// and whole; false if the two disagree
+	static bool CheckChunkBoundaries();
+
+	std::vector<Group>& GetGroups() { return groups; }
+	const std::vector<Material>& GetMaterials() { return materials; }
+
+	~ObjLoader();
+
+private:
+	bool Parse(const char* data, size_t size, const std::string& directory, size_t chunkCount);
+	bool LoadMaterialLibrary(const std::string& fileName);
+	unsigned int FindMaterial(const std::string& name);
+
+	std::vector<Group> groups;
+	std::vector<Material> materials;
+};
+
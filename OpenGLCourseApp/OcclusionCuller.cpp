@@ -0,0 +1,304 @@
+#include "pch.h"
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+
+#include <xmmintrin.h>
+
+// rows per band below which splitting across threads stops paying off
+static const GLuint MIN_BAND_ROWS = 16;
+
+// boxes are tested on the pyramid level where they cover at most this many texels across
+static const GLuint TEST_FOOTPRINT = 4;
+
+OcclusionCuller::OcclusionCuller() : OcclusionCuller(256, 144)
+{
+}
+
+OcclusionCuller::OcclusionCuller(GLuint width, GLuint height)
+{
+	this->width = width;
+	this->height = height;
+
+	GLuint w = width, h = height;
+	while (true)
+	{
+		levels.push_back(std::vector<GLfloat>(w * h, 1.0f));
+		levelWidth.push_back(w);
+		levelHeight.push_back(h);
+
+		if (w == 1 && h == 1)
+		{
+			break;
+		}
+		w = std::max(1u, (w + 1) / 2);
+		h = std::max(1u, (h + 1) / 2);
+	}
+}
+
+void OcclusionCuller::AddOccluder(const GLfloat* vertices, unsigned int numOfVertices, unsigned int vertexLength,
+								const unsigned int* indices, unsigned int numOfIndices, glm::mat4 model)
+{
+	GLuint baseVertex = occluderPositions.size();
+
+	for (unsigned int i = 0; i < numOfVertices; i += vertexLength)
+	{
+		occluderPositions.push_back(glm::vec3(model * glm::vec4(vertices[i], vertices[i + 1], vertices[i + 2], 1.0f)));
+	}
+
+	for (unsigned int i = 0; i < numOfIndices; i++)
+	{
+		occluderIndices.push_back(baseVertex + indices[i]);
+	}
+}
+
+void OcclusionCuller::ClearOccluders()
+{
+	occluderPositions.clear();
+	occluderIndices.clear();
+}
+
+void OcclusionCuller::Render(const glm::mat4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+
+	clipPositions.resize(occluderPositions.size());
+	for (size_t i = 0; i < occluderPositions.size(); i++)
+	{
+		clipPositions[i] = viewProjection * glm::vec4(occluderPositions[i], 1.0f);
+	}
+
+	std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+
+	GLuint threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), height / MIN_BAND_ROWS));
+	if (threadCount == 1)
+	{
+		RasterizeBand(0, height);
+	}
+	else {
+		std::vector<std::thread> threads;
+		for (GLuint t = 0; t < threadCount; t++)
+		{
+			threads.push_back(std::thread(&OcclusionCuller::RasterizeBand, this, height * t / threadCount, height * (t + 1) / threadCount));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+		}
+	}
+
+	BuildHierarchy();
+}
+
+void OcclusionCuller::RasterizeBand(GLuint firstRow, GLuint lastRow)
+{
+	std::vector<GLfloat>& depth = levels[0];
+
+	for (size_t i = 0; i < occluderIndices.size(); i += 3)
+	{
+		glm::vec4 input[3] = { clipPositions[occluderIndices[i]], clipPositions[occluderIndices[i + 1]], clipPositions[occluderIndices[i + 2]] };
+
+		// clip against the near plane (z > -w), leaving a polygon of up to four corners
+		glm::vec4 polygon[4];
+		int corners = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			const glm::vec4& a = input[k];
+			const glm::vec4& b = input[(k + 1) % 3];
+			GLfloat da = a.z + a.w, db = b.z + b.w;
+
+			if (da >= 0.0f)
+			{
+				polygon[corners++] = a;
+			}
+			if ((da >= 0.0f) != (db >= 0.0f))
+			{
+				polygon[corners++] = a + (b - a) * (da / (da - db));
+			}
+		}
+
+		if (corners < 3)
+		{
+			continue;
+		}
+
+		// to pixel space with depth in [0, 1]
+		glm::vec3 screen[4];
+		for (int k = 0; k < corners; k++)
+		{
+			GLfloat inverseW = 1.0f / std::max(polygon[k].w, 1e-6f);
+			screen[k] = glm::vec3((polygon[k].x * inverseW * 0.5f + 0.5f) * width,
+								(polygon[k].y * inverseW * 0.5f + 0.5f) * height,
+								polygon[k].z * inverseW * 0.5f + 0.5f);
+		}
+
+		for (int fan = 1; fan + 1 < corners; fan++)
+		{
+			glm::vec3 v0 = screen[0], v1 = screen[fan], v2 = screen[fan + 1];
+
+			GLfloat area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+			if (fabsf(area) < 1e-8f)
+			{
+				continue;
+			}
+			// occluders are drawn two sided: make the winding counter-clockwise
+			if (area < 0.0f)
+			{
+				std::swap(v1, v2);
+				area = -area;
+			}
+
+			int minX = std::max(0, (int)floorf(std::min(v0.x, std::min(v1.x, v2.x))));
+			int maxX = std::min((int)width - 1, (int)ceilf(std::max(v0.x, std::max(v1.x, v2.x))));
+			int minY = std::max((int)firstRow, (int)floorf(std::min(v0.y, std::min(v1.y, v2.y))));
+			int maxY = std::min((int)lastRow - 1, (int)ceilf(std::max(v0.y, std::max(v1.y, v2.y))));
+			if (minX > maxX || minY > maxY)
+			{
+				continue;
+			}
+
+			// edge functions and the depth plane, evaluated at pixel centres
+			GLfloat e0a = v1.y - v2.y, e0b = v2.x - v1.x, e0c = v1.x * v2.y - v1.y * v2.x;
+			GLfloat e1a = v2.y - v0.y, e1b = v0.x - v2.x, e1c = v2.x * v0.y - v2.y * v0.x;
+			GLfloat e2a = v0.y - v1.y, e2b = v1.x - v0.x, e2c = v0.x * v1.y - v0.y * v1.x;
+
+			GLfloat inverseArea = 1.0f / area;
+			GLfloat dzdx = (e0a * v0.z + e1a * v1.z + e2a * v2.z) * inverseArea;
+			GLfloat dzdy = (e0b * v0.z + e1b * v1.z + e2b * v2.z) * inverseArea;
+			GLfloat z0 = (e0c * v0.z + e1c * v1.z + e2c * v2.z) * inverseArea;
+
+			for (int y = minY; y <= maxY; y++)
+			{
+				GLfloat py = y + 0.5f;
+				GLfloat* row = &depth[y * width];
+
+				const int lanes = 4;
+				__m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+				__m128 zero = _mm_setzero_ps();
+				for (int x = minX; x <= maxX; x += lanes)
+				{
+					__m128 px = _mm_add_ps(_mm_set1_ps((GLfloat)x), laneOffsets);
+					__m128 w0 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e0a)), _mm_set1_ps(e0b * py + e0c));
+					__m128 w1 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e1a)), _mm_set1_ps(e1b * py + e1c));
+					__m128 w2 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e2a)), _mm_set1_ps(e2b * py + e2c));
+					__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+
+					int mask = _mm_movemask_ps(inside);
+					if (!mask)
+					{
+						continue;
+					}
+
+					__m128 z = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(dzdx)), _mm_set1_ps(dzdy * py + z0));
+
+					if (x + lanes <= (int)width)
+					{
+						__m128 current = _mm_loadu_ps(&row[x]);
+						__m128 nearer = _mm_min_ps(current, z);
+						_mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+					}
+					else {
+						GLfloat values[lanes];
+						_mm_storeu_ps(values, z);
+						for (int k = 0; x + k < (int)width; k++)
+						{
+							if (mask & (1 << k)) row[x + k] = std::min(row[x + k], values[k]);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void OcclusionCuller::BuildHierarchy()
+{
+	for (size_t level = 1; level < levels.size(); level++)
+	{
+		const std::vector<GLfloat>& source = levels[level - 1];
+		std::vector<GLfloat>& target = levels[level];
+		GLuint sourceWidth = levelWidth[level - 1], sourceHeight = levelHeight[level - 1];
+
+		for (GLuint y = 0; y < levelHeight[level]; y++)
+		{
+			for (GLuint x = 0; x < levelWidth[level]; x++)
+			{
+				// odd edges fold the last row or column in twice
+				GLuint x0 = std::min(x * 2, sourceWidth - 1), x1 = std::min(x * 2 + 1, sourceWidth - 1);
+				GLuint y0 = std::min(y * 2, sourceHeight - 1), y1 = std::min(y * 2 + 1, sourceHeight - 1);
+
+				target[y * levelWidth[level] + x] = std::max(std::max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+															std::max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::TestBox(const BoundingBox& box) const
+{
+	glm::vec3 minCorner = box.GetMin(), maxCorner = box.GetMax();
+
+	GLfloat minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 corner((i & 1) ? maxCorner.x : minCorner.x, (i & 2) ? maxCorner.y : minCorner.y, (i & 4) ? maxCorner.z : minCorner.z, 1.0f);
+		glm::vec4 clip = viewProjection * corner;
+
+		// crossing the near plane, assume visible
+		if (clip.z < -clip.w)
+		{
+			return true;
+		}
+
+		GLfloat inverseW = 1.0f / clip.w;
+		GLfloat x = (clip.x * inverseW * 0.5f + 0.5f) * width;
+		GLfloat y = (clip.y * inverseW * 0.5f + 0.5f) * height;
+
+		minX = std::min(minX, x); maxX = std::max(maxX, x);
+		minY = std::min(minY, y); maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip.z * inverseW * 0.5f + 0.5f);
+	}
+
+	minX = std::max(minX, 0.0f); minY = std::max(minY, 0.0f);
+	maxX = std::min(maxX, (GLfloat)width - 1.0f); maxY = std::min(maxY, (GLfloat)height - 1.0f);
+	if (minX > maxX || minY > maxY)
+	{
+		// off screen, frustum culling's business
+		return true;
+	}
+
+	// the level where the rectangle is only a few texels across
+	size_t level = 0;
+	GLfloat footprint = std::max(maxX - minX, maxY - minY);
+	while (level + 1 < levels.size() && footprint > TEST_FOOTPRINT)
+	{
+		footprint *= 0.5f;
+		level++;
+	}
+
+	GLuint x0 = (GLuint)minX >> level, x1 = (GLuint)maxX >> level;
+	GLuint y0 = (GLuint)minY >> level, y1 = (GLuint)maxY >> level;
+	x1 = std::min(x1, levelWidth[level] - 1);
+	y1 = std::min(y1, levelHeight[level] - 1);
+
+	const std::vector<GLfloat>& depth = levels[level];
+	for (GLuint y = y0; y <= y1; y++)
+	{
+		for (GLuint x = x0; x <= x1; x++)
+		{
+			if (depth[y * levelWidth[level] + x] >= nearest)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "BoundingBox.h"
+
+// Software occlusion culling on the CPU: a few large occluders are rasterized
+// into a small depth buffer, split into horizontal bands so each thread owns its rows.
+// A max-depth pyramid over that buffer then rejects boxes that are behind everything in the
+// region they cover. Rasterization runs 4 pixels at a time with SSE.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+	OcclusionCuller(GLuint width, GLuint height);
+
+	// world space triangles; positions are the first three of every vertexLength floats
+	void AddOccluder(const GLfloat* vertices, unsigned int numOfVertices, unsigned int vertexLength,
+					const unsigned int* indices, unsigned int numOfIndices, glm::mat4 model);
+	void ClearOccluders();
+
+	void Render(const glm::mat4& viewProjection);
+
+	// false only if the box is certainly hidden behind the occluders of the last Render
+	bool TestBox(const BoundingBox& box) const;
+
+	GLuint GetOccluderTriangles() const { return occluderIndices.size() / 3; }
+
+	~OcclusionCuller();
+
+private:
+	void RasterizeBand(GLuint firstRow, GLuint lastRow);
+	void BuildHierarchy();
+
+	GLuint width, height;
+
+	std::vector<glm::vec3> occluderPositions;
+	std::vector<GLuint> occluderIndices;
+
+	// clip space positions for the current frame
+	std::vector<glm::vec4> clipPositions;
+	glm::mat4 viewProjection;
+
+	// level 0 is the rasterized depth, each further level the farthest depth of 2x2 below it
+	std::vector<std::vector<GLfloat>> levels;
+	std::vector<GLuint> levelWidth, levelHeight;
+};
+
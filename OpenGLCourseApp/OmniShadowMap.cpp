@@ -1,56 +1,101 @@
 #include "pch.h"
 #include "OmniShadowMap.h"
 
-OmniShadowMap::OmniShadowMap() : ShadowMap() {}
+std::vector<ShadowAtlas*> OmniShadowMap::atlases;
 
-bool OmniShadowMap::Init(GLuint width, GLuint height)
+OmniShadowMap::OmniShadowMap() : ShadowMap()
 {
-	shadowWidth = width; shadowHeight = height;
+	atlasIndex = -1;
+	filterAtlasIndex = -1;
+	slot = -1;
+}
 
-	glGenFramebuffers(1, &FBO);
+OmniShadowMap::OmniShadowMap(ShadowFilter filter) : OmniShadowMap()
+{
+	this->filter = filter;
+}
 
-	glGenTextures(1, &shadowMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, shadowMap);
+void OmniShadowMap::AddAtlas(ShadowAtlas * atlas)
+{
+	atlases.push_back(atlas);
+}
 
-	for (size_t i = 0; i < 6; i++)
+bool OmniShadowMap::Init(GLuint width, GLuint height)
+{
+	// smallest atlas that still meets the requested resolution, else the largest one with room
+	for (int i = (int)atlases.size() - 1; i >= 0 && atlasIndex < 0; i--)
 	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, shadowWidth, shadowHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+		if (atlases[i]->GetFilter() == filter && atlases[i]->GetSize() >= width && atlases[i]->GetFreeSlots())
+		{
+			atlasIndex = i;
+		}
 	}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMap, 0);
+	for (size_t i = 0; i < atlases.size() && atlasIndex < 0; i++)
+	{
+		if (atlases[i]->GetFilter() == filter && atlases[i]->GetFreeSlots())
+		{
+			atlasIndex = i;
+		}
+	}
 
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
+	if (atlasIndex < 0)
+	{
+		printf("No free omni shadow atlas slot for a %ux%u shadow map\n", width, height);
+		return false;
+	}
 
-	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	slot = atlases[atlasIndex]->AllocateSlot();
 
-	if (status != GL_FRAMEBUFFER_COMPLETE)
+	filterAtlasIndex = 0;
+	for (int i = 0; i < atlasIndex; i++)
 	{
-		printf("Framebuffer Error: %i\n", status);
-		return false;
+		if (atlases[i]->GetFilter() == filter)
+		{
+			filterAtlasIndex++;
+		}
 	}
 
-	//glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	shadowWidth = atlases[atlasIndex]->GetSize();
+	shadowHeight = shadowWidth;
 
 	return true;
 }
 
 void OmniShadowMap::Write()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	if (atlasIndex < 0)
+	{
+		return;
+	}
+
+	atlases[atlasIndex]->Write(slot);
+}
+
+void OmniShadowMap::WriteFace(GLuint face)
+{
+	if (atlasIndex < 0)
+	{
+		return;
+	}
+
+	atlases[atlasIndex]->WriteFace(slot, face);
 }
 
 void OmniShadowMap::Read(GLenum textureUnit)
 {
-	glActiveTexture(textureUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, shadowMap);
+	if (atlasIndex < 0)
+	{
+		return;
+	}
+
+	atlases[atlasIndex]->Read(textureUnit);
 }
 
-OmniShadowMap::~OmniShadowMap() {}
+OmniShadowMap::~OmniShadowMap()
+{
+	if (atlasIndex >= 0)
+	{
+		atlases[atlasIndex]->ReleaseSlot(slot);
+	}
+}
@@ -1,17 +1,43 @@
 #pragma once
+#include <vector>
+
 #include "ShadowMap.h"
+#include "ShadowAtlas.h"
+
+// An omni light's slot in one of the shared shadow atlases.
+// Atlases are registered from largest to smallest; the index is also the shader's atlas index.
+// A map only goes into an atlas with the same filter.
 class OmniShadowMap :
 	public ShadowMap
 {
 public:
 	OmniShadowMap();
+	OmniShadowMap(ShadowFilter filter);
+
+	static void AddAtlas(ShadowAtlas* atlas);
 
+	// false when no atlas of the map's filter has a free slot; the map then stays empty,
+	// writes and reads do nothing and the shader is given atlas -1
 	bool Init(GLuint width, GLuint height);
+	bool HasSlot() { return atlasIndex >= 0; }
 
 	void Write();
+	void WriteFace(GLuint face);
 
 	void Read(GLenum textureUnit);
 
+	// index among the atlases sharing this map's filter, which is how the shader numbers them
+	int GetAtlasIndex() { return filterAtlasIndex; }
+	int GetCubeIndex() { return slot; }
+	int GetLayer() { return slot * 6; }
+
 	~OmniShadowMap();
+
+private:
+	static std::vector<ShadowAtlas*> atlases;
+
+	int atlasIndex;
+	int filterAtlasIndex;
+	int slot;
 };
 
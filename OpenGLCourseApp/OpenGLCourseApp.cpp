@@ -24,6 +24,19 @@
 #include "SpotLight.h"
 #include "Material.h"
 #include "Model.h"
+#include "Frustum.h"
+#include "ShadowScheduler.h"
+#include "RenderStats.h"
+#include "StaticBatch.h"
+#include "GeometryCache.h"
+#include "NormalGenerator.h"
+#include "BVH.h"
+#include "OcclusionCuller.h"
+#include "GpuCuller.h"
+#include "GBuffer.h"
+#include "LightTiles.h"
+#include "LightAssigner.h"
+#include "ShaderVariants.h"
 
 #include "Skybox.h"
 
@@ -31,13 +44,18 @@ const float toRadians = 3.14159265f / 180.0f;
 
 GLuint uniformProjection = 0, uniformModel = 0, uniformView = 0, uniformEyePosition = 0,
 uniformSpecularIntensity = 0, uniformShininess = 0,
-uniformDirectionalLightTransform = 0, uniformOmniLightPos = 0, uniformFarPlane = 0;
+uniformDirectionalLightTransform = 0, uniformOmniLightPos = 0, uniformFarPlane = 0,
+uniformFaceMask = 0, uniformLayerBase = 0;
 
 Window mainWindow;
-std::vector<Mesh*> meshList;
-std::vector<Shader> shaderList;
+// the forward lighting program, compiled per light count and shadow filter
+ShaderVariants lightingShaders;
 Shader directionalShadowShader;
 Shader omniShadowShader;
+Shader omniShadowFaceShader;
+Shader depthPrepassShader;
+Shader gBufferShader;
+Shader deferredLightingShader;
 
 Camera camera;
 
@@ -51,12 +69,79 @@ Material dullMaterial;
 Model xwing;
 Model blackhawk;
 
+// the floor, the pyramids and the parked x-wing
+StaticBatch staticBatch;
+
+// world bounds of the scene objects for visibility queries: the static draws, then the blackhawk
+BVH sceneBvh;
+std::vector<BoundingBox> sceneBounds;
+std::vector<bool> sceneVisible;
+std::vector<GLuint> sceneQueryResults;
+
+// the large static geometry, simplified, hides scene objects from the camera pass
+OcclusionCuller occlusionCuller;
+bool occlusionCulling = true;
+
+// with OpenGL 4.3 the static batch is culled by a compute shader and drawn indirectly instead;
+// gpuCullPass holds the commands written for the pass being rendered
+GpuCuller gpuCuller;
+bool gpuCullingAvailable = false;
+bool gpuCulling = false;
+GLuint gpuCullPass = 0;
+
 DirectionalLight mainLight;
 PointLight pointLights[MAX_POINT_LIGHTS];
 SpotLight spotLights[MAX_SPOT_LIGHTS];
 
 Skybox skybox;
 
+ShadowAtlas omniShadowAtlases[MAX_SHADOW_ATLASES];
+
+ShadowScheduler shadowScheduler;
+RenderStats renderStats;
+
+// cube faces being rendered by the current omni shadow pass, 0 outside of it
+GLuint activeOmniFaces = 0;
+Frustum omniFaceFrustums[6];
+bool omniPerFacePasses = false;
+
+// camera depth first, then shading with GL_EQUAL so overdraw costs depth tests only
+bool depthPrepass = false;
+
+// the alternative to forward shading: surfaces into a G-buffer, then one lighting pass over
+// the screen in which each tile only evaluates the lights that can reach it
+GBuffer gBuffer;
+LightTiles lightTiles;
+Mesh fullscreenQuad;
+bool deferredAvailable = false;
+bool deferredShading = false;
+
+// forward shading lights each draw with its most significant lights only, picked while the
+// forward lighting pass draws
+LightAssigner lightAssigner;
+bool objectLightLists = false;
+
+// lights left after culling, which the lighting variant is compiled for
+GLuint visiblePointLightCount = 0;
+GLuint visibleSpotLightCount = 0;
+
+ShadowFilter shadowFilter = SHADOW_FILTER_PCF;
+
+// level of detail selection for the current pass: pixels per world unit at unit distance,
+// or at any distance for orthographic passes, and the largest error allowed on screen
+glm::vec3 lodViewPosition;
+GLfloat lodPixelScale = 1.0f;
+bool lodOrthographic = false;
+GLfloat lodMaxPixelError = 1.0f;
+
+// shadow maps tolerate much coarser geometry than the lit view
+const GLfloat SHADOW_LOD_BIAS = 4.0f;
+
+// model clusters are culled in the camera pass only; back faces still cast shadows
+bool clusterCulling = false;
+glm::mat4 clusterViewProjection;
+ClusterView clusterView;
+
 unsigned int pointLightCount = 0;
 unsigned int spotLightCount = 0;
 
@@ -71,40 +156,6 @@ static const char* vShader = "Shaders/shader.vert";
 // Fragment shader
 static const char* fShader = "Shaders/shader.frag";
 
-// A helper function to calculate normal averages
-void calcAverageNormals(unsigned int* indices, unsigned int indiceCount, GLfloat* vertices, unsigned int verticeCount,
-						unsigned int vLength, unsigned int normalOffset)
-{
-	// for each triangle
-	for (size_t i = 0; i < indiceCount; i += 3)
-	{
-		unsigned int in0 = indices[i] * vLength;
-		unsigned int in1 = indices[i + 1] * vLength;
-		unsigned int in2 = indices[i + 2] * vLength;
-		// the edge connecting indices[i] and indices[i + 1]
-		glm::vec3 v1(vertices[in1] - vertices[in0], vertices[in1 + 1] - vertices[in0 + 1], vertices[in1 + 2] - vertices[in0 + 2]);
-		// the edge connecting indices[i] and indices[i + 2]
-		glm::vec3 v2(vertices[in2] - vertices[in0], vertices[in2 + 1] - vertices[in0 + 1], vertices[in2 + 2] - vertices[in0 + 2]);
-		// now calculate the normal based on the two edges above
-		glm::vec3 normal = glm::cross(v1, v2);
-		normal = glm::normalize(normal);
-
-		// now need to save the normal value above to a proper vertex location
-		in0 += normalOffset; in1 += normalOffset; in2 += normalOffset;
-		vertices[in0] += normal.x; vertices[in0 + 1] += normal.y; vertices[in0 + 2] += normal.z;
-		vertices[in1] += normal.x; vertices[in1 + 1] += normal.y; vertices[in1 + 2] += normal.z;
-		vertices[in2] += normal.x; vertices[in2 + 1] += normal.y; vertices[in2 + 2] += normal.z;
-	}
-
-	for (size_t i = 0; i < verticeCount / vLength; i++)
-	{
-		unsigned int nOffset = i * vLength + normalOffset;
-		glm::vec3 vec(vertices[nOffset], vertices[nOffset + 1], vertices[nOffset + 2]);
-		vec = glm::normalize(vec);
-		vertices[nOffset] = vec.x; vertices[nOffset + 1] = vec.y; vertices[nOffset + 2] = vec.z;
-	}
-}
-
 void CreateObjects()
 {
 	unsigned int indices[] = {
@@ -134,79 +185,241 @@ void CreateObjects()
 		10.0f, 0.0f, 10.0f,		10.0f, 10.0f,	0.0f, -1.0f, 0.0f
 	};
 
-	calcAverageNormals(indices, 12, vertices, 32, 8, 5);
+	NormalGenerator::GenerateNormals(vertices, 4, 8, 5, indices, 12, NORMAL_WEIGHT_ANGLE);
 
-	Mesh* obj1 = new Mesh();
-	obj1->CreateMesh(vertices, indices, 32, 12);
-	meshList.push_back(obj1);
+	glm::mat4 model = glm::mat4(1.0);
+	model = glm::translate(model, glm::vec3(0.f, 0.f, -2.5f));
+	staticBatch.Add(vertices, 32, indices, 12, model, &brickTexture, &shinyMaterial);
+	occlusionCuller.AddOccluder(vertices, 32, 8, indices, 12, model);
 
-	Mesh* obj2 = new Mesh();
-	obj2->CreateMesh(vertices, indices, 32, 12);
-	meshList.push_back(obj2);
+	model = glm::mat4(1.0);
+	model = glm::translate(model, glm::vec3(0.f, 4.f, -2.5f));
+	staticBatch.Add(vertices, 32, indices, 12, model, &dirtTexture, &dullMaterial);
+	occlusionCuller.AddOccluder(vertices, 32, 8, indices, 12, model);
 
-	Mesh* obj3 = new Mesh();
-	obj3->CreateMesh(floorVertices, floorindices, 32, 6);
-	meshList.push_back(obj3);
+	model = glm::mat4(1.0);
+	model = glm::translate(model, glm::vec3(0.0f, -2.0f, 0.0f));
+	staticBatch.Add(floorVertices, 32, floorindices, 6, model, &dirtTexture, &shinyMaterial);
+	occlusionCuller.AddOccluder(floorVertices, 32, 8, floorindices, 6, model);
 }
 
 void CreateShaders()
 {
-	Shader* shader1 = new Shader();
-	shader1->CreateFromFiles(vShader, fShader);
-	shaderList.push_back(*shader1);
+	lightingShaders.Init(vShader, fShader);
+
+	// with parallel compiling every variant the scene can need builds in the background up
+	// front; without it they are compiled on first use instead of all at startup
+	if (Shader::EnableParallelCompile())
+	{
+		for (GLuint filter = SHADOW_FILTER_PCF; filter <= SHADOW_FILTER_VSM; filter++)
+		{
+			for (GLuint points = 0; points <= MAX_POINT_LIGHTS; points++)
+			{
+				for (GLuint spots = 0; spots <= MAX_SPOT_LIGHTS; spots++)
+				{
+					ShaderFeatures features;
+					features.pointLights = points;
+					features.spotLights = spots;
+					features.directionalShadowFilter = (ShadowFilter)filter;
+					lightingShaders.Prepare(features);
+				}
+			}
+		}
+	}
 
 	directionalShadowShader = Shader();
 	directionalShadowShader.CreateFromFiles("Shaders/directional_shadow_map.vert", "Shaders/directional_shadow_map.frag");
 
 	omniShadowShader = Shader();
 	omniShadowShader.CreateFromFiles("Shaders/omni_shadow_map.vert", "Shaders/omni_shadow_map.geom", "Shaders/omni_shadow_map.frag");
+
+	omniShadowFaceShader = Shader();
+	omniShadowFaceShader.CreateFromFiles("Shaders/omni_shadow_map_face.vert", "Shaders/omni_shadow_map.frag");
+
+	depthPrepassShader = Shader();
+	depthPrepassShader.CreateFromFiles("Shaders/depth_prepass.vert", "Shaders/depth_prepass.frag");
+
+	gBufferShader = Shader();
+	gBufferShader.CreateFromFiles("Shaders/gbuffer.vert", "Shaders/gbuffer.frag");
+
+	deferredLightingShader = Shader();
+	deferredLightingShader.CreateFromFiles("Shaders/deferred_lighting.vert", "Shaders/deferred_lighting.frag");
 }
 
-void RenderScene()
+// Uploads the model matrix, or returns false if the object can be skipped for the current pass.
+// Bounds are in object space; vertexTransform maps quantized vertices there and is only uploaded.
+bool UseModelMatrix(glm::mat4 model, const BoundingBox& bounds, const glm::mat4& vertexTransform)
 {
-	glm::mat4 model = glm::mat4(1.0);
-	model = glm::translate(model, glm::vec3(0.f, 0.f, -2.5f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	brickTexture.UseTexture();
-	shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	meshList[0]->RenderMesh();
+	if (activeOmniFaces)
+	{
+		BoundingBox worldBounds = bounds.Transform(model);
 
-	model = glm::mat4(1.0);
-	model = glm::translate(model, glm::vec3(0.f, 4.f, -2.5f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	dirtTexture.UseTexture();
-	dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	meshList[1]->RenderMesh();
+		GLuint faceMask = 0;
+		for (size_t i = 0; i < 6; i++)
+		{
+			if (!(activeOmniFaces & (1 << i)))
+			{
+				continue;
+			}
+
+			if (omniFaceFrustums[i].TestBox(worldBounds))
+			{
+				faceMask |= 1 << i;
+			}
+			else {
+				renderStats.culledFaceDraws++;
+			}
+		}
 
-	model = glm::mat4(1.0);
-	model = glm::translate(model, glm::vec3(0.0f, -2.0f, 0.0f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	dirtTexture.UseTexture();
-	shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	meshList[2]->RenderMesh();
+		if (!faceMask)
+		{
+			return false;
+		}
 
-	model = glm::mat4(1.0);
-	model = glm::translate(model, glm::vec3(-7.0f, 0.0f, 10.0f));
-	model = glm::scale(model, glm::vec3(0.006f, 0.006f, 0.006f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	xwing.RenderModel();
-
-	blackhawkAngle += 0.1f;
-	if (blackhawkAngle > 360.0f)
+		Shader::Uniform1i(uniformFaceMask, faceMask);
+	}
+
+	if (objectLightLists)
 	{
-		blackhawkAngle = 0.1f;
+		GLuint lights[MAX_OBJECT_LIGHTS];
+		GLuint lightCount = lightAssigner.Assign(bounds.Transform(model), lights, MAX_OBJECT_LIGHTS);
+		Shader::SetObjectLights(lights, lightCount);
 	}
 
-	model = glm::mat4(1.0);
+	glm::mat4 vertexModel = model * vertexTransform;
+	Shader::UniformMatrix4fv(uniformModel, vertexModel);
+	return true;
+}
+
+bool UseModelMatrix(glm::mat4 model, const BoundingBox& bounds)
+{
+	return UseModelMatrix(model, bounds, glm::mat4(1.0f));
+}
+
+// Pixels covered by one object space unit of a model drawn with this matrix in the current pass
+GLfloat CalcLodPixelsPerUnit(glm::mat4 model, const BoundingBox& bounds)
+{
+	GLfloat scale = glm::length(glm::vec3(model[0]));
+	if (lodOrthographic)
+	{
+		return lodPixelScale * scale;
+	}
+
+	// nearest point of the bounding sphere, clamped so the camera inside a model keeps full detail
+	BoundingBox worldBounds = bounds.Transform(model);
+	GLfloat distance = glm::length(worldBounds.GetCentre() - lodViewPosition) - worldBounds.GetRadius();
+
+	return lodPixelScale * scale / glm::max(distance, 0.01f);
+}
+
+// The camera's frustum and position in the object space of a model, or null outside the camera pass
+const ClusterView* CalcClusterView(glm::mat4 model)
+{
+	if (!clusterCulling)
+	{
+		return nullptr;
+	}
+
+	clusterView.frustum = Frustum(clusterViewProjection * model);
+	clusterView.viewPosition = glm::vec3(glm::inverse(model) * glm::vec4(camera.getCameraPosition(), 1.0f));
+	clusterView.cullBackfaces = true;
+
+	return &clusterView;
+}
+
+glm::mat4 CalcBlackhawkModel()
+{
+	glm::mat4 model = glm::mat4(1.0);
 	model = glm::rotate(model, -blackhawkAngle * toRadians, glm::vec3(0.0f, 1.0f, 0.0f));
 	model = glm::translate(model, glm::vec3(-8.0f, 2.0f, 0.0f));
 	model = glm::rotate(model, -20.0f * toRadians, glm::vec3(0.0f, 0.0f, 1.0f));
 	model = glm::rotate(model, -90.0f * toRadians, glm::vec3(1.0f, 0.0f, 0.0f));
 	model = glm::scale(model, glm::vec3(0.4f, 0.4f, 0.4f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	blackhawk.RenderModel();
+	return model;
+}
+
+void BuildSceneBvh()
+{
+	const std::vector<StaticBatch::Draw>& staticDraws = staticBatch.GetDraws();
+
+	sceneBounds.clear();
+	for (size_t i = 0; i < staticDraws.size(); i++)
+	{
+		sceneBounds.push_back(staticDraws[i].bounds);
+	}
+	sceneBounds.push_back(blackhawk.GetBounds().Transform(CalcBlackhawkModel()));
+
+	sceneVisible.assign(sceneBounds.size(), true);
+	sceneBvh.Build(sceneBounds);
+}
+
+// Moving objects only need their boxes refreshed, the tree itself stays
+void UpdateSceneBvh()
+{
+	sceneBounds.back() = blackhawk.GetBounds().Transform(CalcBlackhawkModel());
+	sceneBvh.Refit(sceneBounds);
+}
+
+// Marks the objects the last query returned as the ones RenderScene draws
+void MarkSceneVisible()
+{
+	std::fill(sceneVisible.begin(), sceneVisible.end(), false);
+	for (size_t i = 0; i < sceneQueryResults.size(); i++)
+	{
+		sceneVisible[sceneQueryResults[i]] = true;
+	}
+}
+
+void RenderScene()
+{
+	const std::vector<StaticBatch::Draw>& staticDraws = staticBatch.GetDraws();
+	if (gpuCulling)
+	{
+		// the light sphere was tested on the GPU, the geometry shader clips to the faces
+		if (activeOmniFaces)
+		{
+			Shader::Uniform1i(uniformFaceMask, activeOmniFaces);
+		}
+		Shader::UniformMatrix4fv(uniformModel, glm::mat4(1.0f));
+
+		// the draws that survive culling are unknown here, so every draw gets its list
+		if (objectLightLists)
+		{
+			std::vector<GLint> drawLights(staticDraws.size() * MAX_OBJECT_LIGHTS, -1);
+			for (size_t i = 0; i < staticDraws.size(); i++)
+			{
+				GLuint lights[MAX_OBJECT_LIGHTS];
+				GLuint lightCount = lightAssigner.Assign(staticDraws[i].bounds, lights, MAX_OBJECT_LIGHTS);
+				for (size_t j = 0; j < lightCount; j++)
+				{
+					drawLights[i * MAX_OBJECT_LIGHTS + j] = lights[j];
+				}
+			}
+			gpuCuller.SetObjectLights(drawLights);
+		}
+
+		gpuCuller.Render(gpuCullPass, uniformSpecularIntensity, uniformShininess, objectLightLists);
+	}
+	else {
+		for (size_t i = 0; i < staticDraws.size(); i++)
+		{
+			if (sceneVisible[i] && UseModelMatrix(glm::mat4(1.0), staticDraws[i].bounds))
+			{
+				staticDraws[i].texture->UseTexture();
+				staticDraws[i].material->UseMaterial(uniformSpecularIntensity, uniformShininess);
+				staticDraws[i].mesh->RenderRange(staticDraws[i].indexOffset, staticDraws[i].indexCount);
+				renderStats.triangles += staticDraws[i].indexCount / 3;
+			}
+		}
+	}
+
+	glm::mat4 model = CalcBlackhawkModel();
+	if (sceneVisible[staticDraws.size()] && UseModelMatrix(model, blackhawk.GetBounds(), blackhawk.GetVertexTransform()))
+	{
+		shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
+		renderStats.triangles += blackhawk.RenderModel(CalcLodPixelsPerUnit(model, blackhawk.GetBounds()), lodMaxPixelError,
+			CalcClusterView(model));
+	}
 }
 
 void DirectionalShadowMapPass(DirectionalLight* light)
@@ -219,37 +432,287 @@ void DirectionalShadowMapPass(DirectionalLight* light)
 	glClear(GL_DEPTH_BUFFER_BIT);
 
 	uniformModel = directionalShadowShader.GetModelLocation();
-	directionalShadowShader.SetDirectionalLightTransform(&light->CalculateLightTransform());
+	glm::mat4 lightTransform = light->CalculateLightTransform();
+	directionalShadowShader.SetDirectionalLightTransform(&lightTransform);
+
+	// orthographic: clip units per world unit is the length of the transform's first row
+	lodOrthographic = true;
+	lodPixelScale = glm::length(glm::vec3(lightTransform[0][0], lightTransform[1][0], lightTransform[2][0]))
+		* light->GetShadowMap()->GetShadowWidth() * 0.5f;
+	lodMaxPixelError = SHADOW_LOD_BIAS;
+
+	sceneBvh.QueryFrustum(Frustum(lightTransform), sceneQueryResults);
+	MarkSceneVisible();
+
+	if (gpuCulling)
+	{
+		gpuCullPass = gpuCuller.Cull(lightTransform, false);
+	}
 
 	directionalShadowShader.Validate();
 
 	RenderScene();
 
+	// blur and mipmap variance shadow maps, a no-op for plain depth maps
+	light->GetShadowMap()->Resolve();
+
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void OmniShadowMapPass(PointLight* light)
 {
-	omniShadowShader.UseShader();
-
 	glViewport(0, 0, light->GetShadowMap()->GetShadowWidth(), light->GetShadowMap()->GetShadowHeight());
 
-	light->GetShadowMap()->Write();
-	glClear(GL_DEPTH_BUFFER_BIT);
+	std::vector<glm::mat4> lightMatrices = light->CalculateLightTransform();
+	for (size_t i = 0; i < 6; i++)
+	{
+		omniFaceFrustums[i] = Frustum(lightMatrices[i]);
+	}
+
+	OmniShadowMap* shadowMap = (OmniShadowMap*)light->GetShadowMap();
+	Shader* shader = omniPerFacePasses ? &omniShadowFaceShader : &omniShadowShader;
+
+	shader->UseShader();
+
+	uniformModel = shader->GetModelLocation();
+	uniformOmniLightPos = shader->GetOmniLightPosLocation();
+	uniformFarPlane = shader->GetFarPlaneLocation();
+	uniformFaceMask = shader->GetFaceMaskLocation();
+	uniformLayerBase = shader->GetLayerBaseLocation();
+
+	Shader::Uniform1i(uniformLayerBase, shadowMap->GetLayer());
+	Shader::Uniform3f(uniformOmniLightPos, light->GetPosition().x, light->GetPosition().y, light->GetPosition().z);
+	Shader::Uniform1f(uniformFarPlane, light->GetFarPlane());
+
+	// 90 degree faces: half the face resolution in pixels per unit at unit distance
+	lodOrthographic = false;
+	lodViewPosition = light->GetPosition();
+	lodPixelScale = shadowMap->GetShadowWidth() * 0.5f;
+	lodMaxPixelError = SHADOW_LOD_BIAS;
+
+	// nothing past the far plane can cast into this light's map, and nothing past its range
+	// can stand between it and a surface it lights
+	GLfloat shadowRadius = glm::min(light->GetFarPlane(), light->GetRange());
+	sceneBvh.QuerySphere(light->GetPosition(), shadowRadius, sceneQueryResults);
+	MarkSceneVisible();
+
+	if (gpuCulling)
+	{
+		gpuCullPass = gpuCuller.Cull(light->GetPosition(), shadowRadius);
+	}
+
+	if (omniPerFacePasses)
+	{
+		// one plain pass per face; objects outside a face's frustum are never submitted to it
+		for (GLuint face = 0; face < 6; face++)
+		{
+			shadowMap->WriteFace(face);
+
+			shader->SetLightMatrix(&lightMatrices[face]);
+			shader->Validate();
+
+			activeOmniFaces = 1 << face;
+			RenderScene();
+		}
+	}
+	else {
+		// Write only clears this light's slot, a glClear here would wipe the whole atlas
+		shadowMap->Write();
+
+		shader->SetLightMatrices(lightMatrices);
+		shader->Validate();
+
+		activeOmniFaces = 0x3F;
+		RenderScene();
+	}
+
+	activeOmniFaces = 0;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
 
-	uniformModel = omniShadowShader.GetModelLocation();
-	uniformOmniLightPos = omniShadowShader.GetOmniLightPosLocation();
-	uniformFarPlane = omniShadowShader.GetFarPlaneLocation();
+// Lays down the camera depth without shading, so the lighting pass runs its shader once per pixel
+void DepthPrepass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
+{
+	depthPrepassShader.UseShader();
 
-	glUniform3f(uniformOmniLightPos, light->GetPosition().x, light->GetPosition().y, light->GetPosition().z);
-	glUniform1f(uniformFarPlane, light->GetFarPlane());
-	omniShadowShader.SetLightMatrices(light->CalculateLightTransform());
+	uniformModel = depthPrepassShader.GetModelLocation();
+	uniformSpecularIntensity = depthPrepassShader.GetSpecularIntensityLocation();
+	uniformShininess = depthPrepassShader.GetShininessLocation();
 
-	omniShadowShader.Validate();
+	Shader::UniformMatrix4fv(depthPrepassShader.GetProjectionLocation(), projectionMatrix);
+	Shader::UniformMatrix4fv(depthPrepassShader.GetViewLocation(), viewMatrix);
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	RenderScene();
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// Binds a lighting shader with the camera, every light and every shadow map
+void UseLightingShader(Shader* shader, glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
+{
+	shader->UseShader();
+
+	uniformModel = shader->GetModelLocation();
+	uniformProjection = shader->GetProjectionLocation();
+	uniformView = shader->GetViewLocation();
+	uniformEyePosition = shader->GetEyePositionLocation();
+	uniformSpecularIntensity = shader->GetSpecularIntensityLocation();
+	uniformShininess = shader->GetShininessLocation();
+
+	Shader::UniformMatrix4fv(uniformProjection, projectionMatrix);
+	Shader::UniformMatrix4fv(uniformView, viewMatrix);
+	Shader::Uniform3f(uniformEyePosition, camera.getCameraPosition().x, camera.getCameraPosition().y, camera.getCameraPosition().z);
+
+	shader->SetDirectionalLight(&mainLight);
+	GLuint visiblePointLights = shader->SetPointLights(pointLights, pointLightCount, 0);
+	shader->SetSpotLights(spotLights, spotLightCount, visiblePointLights);
+	shader->SetDirectionalLightTransform(&mainLight.CalculateLightTransform());
+
+	// shadow and plain samplers may not share a unit, so depth and moments get one each
+	if (mainLight.GetShadowMap()->GetFilter() == SHADOW_FILTER_VSM)
+	{
+		mainLight.GetShadowMap()->Read(GL_TEXTURE3);
+	}
+	else {
+		mainLight.GetShadowMap()->Read(GL_TEXTURE2);
+	}
+	shader->SetTexture(1);
+	shader->SetDirectionalShadowMap(2, 3);
+
+	GLuint depthAtlases = 0, momentAtlases = 0;
+	for (size_t i = 0; i < MAX_SHADOW_ATLASES; i++)
+	{
+		ShadowFilter filter = omniShadowAtlases[i].GetFilter();
+
+		omniShadowAtlases[i].Read(GL_TEXTURE4 + i);
+		shader->SetOmniShadowAtlas(filter, filter == SHADOW_FILTER_VSM ? momentAtlases++ : depthAtlases++, 4 + i);
+	}
+
+	shader->Validate();
+}
+
+// Fills the G-buffer, then lights every covered pixel once with the lights of its tile
+void DeferredPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
+{
+	gBuffer.Write();
+
+	gBufferShader.UseShader();
+
+	uniformModel = gBufferShader.GetModelLocation();
+	uniformSpecularIntensity = gBufferShader.GetSpecularIntensityLocation();
+	uniformShininess = gBufferShader.GetShininessLocation();
+
+	Shader::UniformMatrix4fv(gBufferShader.GetProjectionLocation(), projectionMatrix);
+	Shader::UniformMatrix4fv(gBufferShader.GetViewLocation(), viewMatrix);
+	gBufferShader.SetTexture(1);
 
 	RenderScene();
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, 1920, 1080);
+
+	// bits in the order the visible lights are uploaded in
+	glm::mat4 viewProjection = projectionMatrix * viewMatrix;
+	lightTiles.Clear();
+
+	GLuint bit = 0;
+	glm::vec3 centre;
+	GLfloat radius;
+	for (size_t i = 0; i < pointLightCount; i++)
+	{
+		if (pointLights[i].IsVisible())
+		{
+			pointLights[i].GetBounds(centre, radius);
+			lightTiles.AddLight(bit++, centre, radius, viewProjection);
+		}
+	}
+	for (size_t i = 0; i < spotLightCount; i++)
+	{
+		if (spotLights[i].IsVisible())
+		{
+			spotLights[i].GetBounds(centre, radius);
+			lightTiles.AddLight(bit++, centre, radius, viewProjection);
+		}
+	}
+	lightTiles.Upload();
+
+	UseLightingShader(&deferredLightingShader, projectionMatrix, viewMatrix);
+
+	gBuffer.Read(GL_TEXTURE7, GL_TEXTURE8, GL_TEXTURE9);
+	deferredLightingShader.SetGBuffer(7, 8, 9);
+	lightTiles.Read(GL_TEXTURE10);
+	deferredLightingShader.SetLightTiles(10, lightTiles.GetTileSize());
+
+	glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+	deferredLightingShader.SetInverseViewProjection(&inverseViewProjection);
+
+	// the quad writes the G-buffer's depth back, so it must never fail the test
+	glDepthFunc(GL_ALWAYS);
+
+	renderStats.BeginFragmentQuery();
+	fullscreenQuad.RenderMesh();
+	renderStats.EndFragmentQuery(mainWindow.getBufferWidth() * mainWindow.getBufferHeight());
+
+	glDepthFunc(GL_LESS);
+}
+
+bool IsLightVisible(PointLight* light, const Frustum& frustum)
+{
+	if (!light->IsOn())
+	{
+		return false;
+	}
+
+	glm::vec3 centre;
+	GLfloat radius;
+	light->GetBounds(centre, radius);
+
+	if (!frustum.TestSphere(centre, radius))
+	{
+		return false;
+	}
+
+	return !occlusionCulling || occlusionCuller.TestBox(BoundingBox(centre - glm::vec3(radius), centre + glm::vec3(radius)));
+}
+
+// Marks the lights whose reach is on screen; the others get no shadow pass and no upload
+void CullLights(const glm::mat4& viewProjection)
+{
+	Frustum frustum(viewProjection);
+
+	for (size_t i = 0; i < pointLightCount; i++)
+	{
+		pointLights[i].SetVisible(IsLightVisible(&pointLights[i], frustum));
+		renderStats.culledLights += pointLights[i].IsVisible() ? 0 : 1;
+	}
+	for (size_t i = 0; i < spotLightCount; i++)
+	{
+		spotLights[i].SetVisible(IsLightVisible(&spotLights[i], frustum));
+		renderStats.culledLights += spotLights[i].IsVisible() ? 0 : 1;
+	}
+
+	// in the order the shader uploads them: visible point lights, then visible spot lights
+	lightAssigner.Clear();
+	visiblePointLightCount = 0;
+	visibleSpotLightCount = 0;
+	for (size_t i = 0; i < pointLightCount; i++)
+	{
+		if (pointLights[i].IsVisible())
+		{
+			visiblePointLightCount++;
+			lightAssigner.AddPointLight(pointLights[i].GetPosition(), pointLights[i].GetRange(), pointLights[i].GetIntensity());
+		}
+	}
+	for (size_t i = 0; i < spotLightCount; i++)
+	{
+		if (spotLights[i].IsVisible())
+		{
+			visibleSpotLightCount++;
+			lightAssigner.AddSpotLight(spotLights[i].GetPosition(), spotLights[i].GetDirection(), spotLights[i].GetConeCos(),
+				spotLights[i].GetRange(), spotLights[i].GetIntensity());
+		}
+	}
 }
 
 void RenderPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
@@ -260,37 +723,73 @@ void RenderPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	skybox.DrawSkybox(viewMatrix, projectionMatrix);
+	// visibility is settled before drawing, so the pre-pass and the lighting pass draw the same
+	lodOrthographic = false;
+	lodViewPosition = camera.getCameraPosition();
+	lodPixelScale = projectionMatrix[1][1] * mainWindow.getBufferHeight() * 0.5f;
+	lodMaxPixelError = 1.0f;
+
+	clusterCulling = true;
+	clusterViewProjection = projectionMatrix * viewMatrix;
+
+	sceneBvh.QueryFrustum(Frustum(clusterViewProjection), sceneQueryResults);
+	MarkSceneVisible();
 
-	shaderList[0].UseShader();
+	if (occlusionCulling)
+	{
+		// the GPU tests the static draws itself, leaving only the moving objects here
+		size_t first = gpuCulling ? staticBatch.GetDraws().size() : 0;
+		for (size_t i = first; i < sceneVisible.size(); i++)
+		{
+			if (sceneVisible[i] && !occlusionCuller.TestBox(sceneBounds[i]))
+			{
+				sceneVisible[i] = false;
+				renderStats.occludedObjects++;
+			}
+		}
+	}
+
+	if (gpuCulling)
+	{
+		gpuCullPass = gpuCuller.Cull(clusterViewProjection, true);
+	}
+
+	if (deferredShading)
+	{
+		DeferredPass(projectionMatrix, viewMatrix);
+	}
+	else {
+		if (depthPrepass)
+		{
+			DepthPrepass(projectionMatrix, viewMatrix);
 
-	uniformModel = shaderList[0].GetModelLocation();
-	uniformProjection = shaderList[0].GetProjectionLocation();
-	uniformView = shaderList[0].GetViewLocation();
-	uniformEyePosition = shaderList[0].GetEyePositionLocation();
-	uniformSpecularIntensity = shaderList[0].GetSpecularIntensityLocation();
-	uniformShininess = shaderList[0].GetShininessLocation();
+			// only the nearest surface of each pixel passes now
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+		}
 
-	glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
-	glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(viewMatrix));
-	glUniform3f(uniformEyePosition, camera.getCameraPosition().x, camera.getCameraPosition().y, camera.getCameraPosition().z);
+		ShaderFeatures features;
+		features.pointLights = visiblePointLightCount;
+		features.spotLights = visibleSpotLightCount;
+		features.directionalShadowFilter = mainLight.GetShadowMap()->GetFilter();
 
-	shaderList[0].SetDirectionalLight(&mainLight);
-	shaderList[0].SetPointLights(pointLights, pointLightCount, 3, 0);
-	shaderList[0].SetSpotLights(spotLights, spotLightCount, 3 + pointLightCount, pointLightCount);
-	shaderList[0].SetDirectionalLightTransform(&mainLight.CalculateLightTransform());
+		Shader* lightingShader = lightingShaders.GetVariant(features);
+		UseLightingShader(lightingShader, projectionMatrix, viewMatrix);
 
-	mainLight.GetShadowMap()->Read(GL_TEXTURE2);
-	shaderList[0].SetTexture(1);
-	shaderList[0].SetDirectionalShadowMap(2);
+		objectLightLists = true;
+		renderStats.BeginFragmentQuery();
+		RenderScene();
+		renderStats.EndFragmentQuery(mainWindow.getBufferWidth() * mainWindow.getBufferHeight());
+		objectLightLists = false;
 
-	glm::vec3 lowerLight = camera.getCameraPosition();
-	lowerLight.y -= 0.3f;
-	spotLights[0].SetFlash(lowerLight, camera.getCameraDirection());
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
 
-	shaderList[0].Validate();
+	clusterCulling = false;
 
-	RenderScene();
+	// last, so only pixels left uncovered by the scene run the sky shader
+	skybox.DrawSkybox(viewMatrix, projectionMatrix);
 }
 
 int main()
@@ -298,6 +797,22 @@ int main()
 	mainWindow = Window(1920, 1080);
 	mainWindow.initialise();
 
+	// every omni light takes a slot in one of these instead of its own cube map; V switches
+	// every omni light to VSM at once, so the moment atlas has a slot for each of them.
+	// The lighting shaders sample them as cube map arrays and cannot be drawn without, so
+	// startup stops here, before any other GL object exists
+	if (!omniShadowAtlases[0].Init(1024, 4, SHADOW_FILTER_PCF) ||
+		!omniShadowAtlases[1].Init(512, 4, SHADOW_FILTER_PCF) ||
+		!omniShadowAtlases[2].Init(512, MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS, SHADOW_FILTER_VSM))
+	{
+		printf("Omni shadow atlases could not be created\n");
+		return 1;
+	}
+	for (size_t i = 0; i < MAX_SHADOW_ATLASES; i++)
+	{
+		OmniShadowMap::AddAtlas(&omniShadowAtlases[i]);
+	}
+
 	CreateObjects();
 	CreateShaders();
 
@@ -319,6 +834,34 @@ int main()
 	blackhawk = Model();
 	blackhawk.LoadModel("Models/uh60.obj");
 
+	glm::mat4 xwingModel = glm::mat4(1.0);
+	xwingModel = glm::translate(xwingModel, glm::vec3(-7.0f, 0.0f, 10.0f));
+	xwingModel = glm::scale(xwingModel, glm::vec3(0.006f, 0.006f, 0.006f));
+	xwing.AddToBatch(&staticBatch, xwingModel, &shinyMaterial);
+	xwing.AddOccluder(&occlusionCuller, xwingModel);
+
+	staticBatch.Build();
+	BuildSceneBvh();
+
+	printf("Geometry cache: %u buffer sets, %u KB shared between identical meshes\n",
+		(GLuint)GeometryCache::GetEntryCount(), GeometryCache::GetSharedBytes() / 1024);
+	printf("Occlusion culling: %u occluder triangles\n", occlusionCuller.GetOccluderTriangles());
+
+	GLfloat quadVertices[] = {
+		-1.0f, -1.0f, 0.0f,		0.0f, 0.0f,		0.0f, 0.0f, 1.0f,
+		1.0f, -1.0f, 0.0f,		1.0f, 0.0f,		0.0f, 0.0f, 1.0f,
+		1.0f, 1.0f, 0.0f,		1.0f, 1.0f,		0.0f, 0.0f, 1.0f,
+		-1.0f, 1.0f, 0.0f,		0.0f, 1.0f,		0.0f, 0.0f, 1.0f
+	};
+	unsigned int quadIndices[] = { 0, 1, 2, 0, 2, 3 };
+	fullscreenQuad.CreateMesh(quadVertices, quadIndices, 32, 6);
+
+	deferredAvailable = gBuffer.Init(mainWindow.getBufferWidth(), mainWindow.getBufferHeight()) &&
+		lightTiles.Init(mainWindow.getBufferWidth(), mainWindow.getBufferHeight(), 16);
+
+	gpuCullingAvailable = gpuCuller.Init(staticBatch.GetDraws(), mainWindow.getBufferWidth(), mainWindow.getBufferHeight());
+	gpuCulling = gpuCullingAvailable;
+
 	mainLight = DirectionalLight(2048, 2048,
 								1.0f, 0.53f, 0.3f,
 								0.1f, 0.9f,
@@ -348,7 +891,7 @@ int main()
 							1.0f, 0.0f, 0.0f,
 							20.0f);
 	spotLightCount++;
-	spotLights[1] = SpotLight(1024, 1024,
+	spotLights[1] = SpotLight(512, 512,
 							0.01f, 100.0f,
 							1.0f, 1.0f, 1.0f,
 							0.0f, 1.0f,
@@ -368,6 +911,17 @@ int main()
 
 	skybox = Skybox(skyboxFaces);
 
+	// two cube maps per frame; a light on screen never uses a map more than 30 frames old
+	shadowScheduler = ShadowScheduler(12, 30);
+	for (size_t i = 0; i < pointLightCount; i++)
+	{
+		shadowScheduler.AddLight(&pointLights[i]);
+	}
+	for (size_t i = 0; i < spotLightCount; i++)
+	{
+		shadowScheduler.AddLight(&spotLights[i]);
+	}
+
 	glm::mat4 projection = glm::perspective(glm::radians(60.0f), mainWindow.getBufferWidth() / mainWindow.getBufferHeight(), 0.1f, 100.f);
 
 	// Loop until window closed
@@ -389,21 +943,125 @@ int main()
 			mainWindow.getKeys()[GLFW_KEY_L] = false;
 		}
 
+		if (mainWindow.getKeys()[GLFW_KEY_G])
+		{
+			omniPerFacePasses = !omniPerFacePasses;
+			mainWindow.getKeys()[GLFW_KEY_G] = false;
+		}
+
+		if (mainWindow.getKeys()[GLFW_KEY_V])
+		{
+			shadowFilter = shadowFilter == SHADOW_FILTER_PCF ? SHADOW_FILTER_VSM : SHADOW_FILTER_PCF;
+			printf("Shadow filter: %s\n", shadowFilter == SHADOW_FILTER_VSM ? "VSM" : "PCF");
+
+			mainLight.SetShadowFilter(shadowFilter);
+			for (size_t i = 0; i < pointLightCount; i++)
+			{
+				pointLights[i].SetShadowFilter(shadowFilter);
+			}
+			for (size_t i = 0; i < spotLightCount; i++)
+			{
+				spotLights[i].SetShadowFilter(shadowFilter);
+			}
+			shadowScheduler.InvalidateAll();
+
+			mainWindow.getKeys()[GLFW_KEY_V] = false;
+		}
+
+		if (mainWindow.getKeys()[GLFW_KEY_O])
+		{
+			occlusionCulling = !occlusionCulling;
+			printf("Occlusion culling: %s\n", occlusionCulling ? "on" : "off");
+			mainWindow.getKeys()[GLFW_KEY_O] = false;
+		}
+
+		if (mainWindow.getKeys()[GLFW_KEY_C])
+		{
+			gpuCulling = gpuCullingAvailable && !gpuCulling;
+			printf("Static batch culling: %s\n", gpuCulling ? "GPU" : "CPU");
+			mainWindow.getKeys()[GLFW_KEY_C] = false;
+		}
+
+		if (mainWindow.getKeys()[GLFW_KEY_Z])
+		{
+			depthPrepass = !depthPrepass;
+			printf("Depth pre-pass: %s\n", depthPrepass ? "on" : "off");
+			mainWindow.getKeys()[GLFW_KEY_Z] = false;
+		}
+
+		if (mainWindow.getKeys()[GLFW_KEY_X])
+		{
+			deferredShading = deferredAvailable && !deferredShading;
+			printf("Shading: %s\n", deferredShading ? "tiled deferred" : "forward");
+			mainWindow.getKeys()[GLFW_KEY_X] = false;
+		}
+
+		if (mainWindow.getKeys()[GLFW_KEY_P])
+		{
+			renderStats.Toggle();
+			mainWindow.getKeys()[GLFW_KEY_P] = false;
+		}
+
+		blackhawkAngle += 0.1f;
+		if (blackhawkAngle > 360.0f)
+		{
+			blackhawkAngle = 0.1f;
+		}
+		UpdateSceneBvh();
+
+		renderStats.BeginFrame();
+		gpuCuller.BeginFrame();
+
+		glm::vec3 lowerLight = camera.getCameraPosition();
+		lowerLight.y -= 0.3f;
+		spotLights[0].SetFlash(lowerLight, camera.getCameraDirection());
+
+		// the occluders go in first, lights and objects are both tested against them
+		glm::mat4 viewProjection = projection * camera.calculateViewMatrix();
+		if (occlusionCulling)
+		{
+			occlusionCuller.Render(viewProjection);
+		}
+		CullLights(viewProjection);
+
 		DirectionalShadowMapPass(&mainLight);
-		for (size_t i = 0; i < pointLightCount; i++)
+
+		std::vector<PointLight*> shadowLights = shadowScheduler.Schedule(camera.getCameraPosition());
+		for (size_t i = 0; i < shadowLights.size(); i++)
 		{
-			OmniShadowMapPass(&pointLights[i]);
+			OmniShadowMapPass(shadowLights[i]);
 		}
-		for (size_t i = 0; i < spotLightCount; i++)
+		renderStats.shadowFaces += shadowScheduler.GetScheduledFaces();
+
+		for (size_t i = 0; i < MAX_SHADOW_ATLASES; i++)
 		{
-			OmniShadowMapPass(&spotLights[i]);
+			omniShadowAtlases[i].Resolve();
 		}
+
+		renderStats.BeginGpuTimer();
 		RenderPass(projection, camera.calculateViewMatrix());
+		renderStats.EndGpuTimer();
+
+		// next frame's occlusion test runs against this frame's depth
+		if (gpuCulling)
+		{
+			gpuCuller.UpdateOcclusion(projection * camera.calculateViewMatrix());
+		}
 
-		glUseProgram(0);
+		Shader::Rebind(nullptr);
 
 		mainWindow.swapBuffers();
+
+		renderStats.skippedUniforms = Shader::TakeSkippedUploads();
+		renderStats.EndFrame(now, deltaTime);
 	}
 
+	// meshes give their buffers back to the geometry cache, which has to happen while it and
+	// the context still exist rather than in static destruction
+	fullscreenQuad.ClearMesh();
+	staticBatch.Clear();
+	xwing.ClearModel();
+	blackhawk.ClearModel();
+
 	return 0;
 }
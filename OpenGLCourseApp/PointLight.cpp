@@ -1,6 +1,10 @@
 #include "pch.h"
 #include "PointLight.h"
 
+#include "Shader.h"
+
+#include "CommonValues.h"
+
 
 PointLight::PointLight() : Light()
 {
@@ -8,6 +12,15 @@ PointLight::PointLight() : Light()
 	constant = 1.0f;
 	linear = 0.0f;
 	exponent = 0.0f;
+
+	nearPlane = 0.01f;
+	farPlane = 100.0f;
+
+	requestedShadowWidth = 0;
+	requestedShadowHeight = 0;
+
+	visible = true;
+	CalcRange();
 }
 
 PointLight::PointLight(GLuint shadowWidth, GLuint shadowHeight,
@@ -22,27 +35,61 @@ PointLight::PointLight(GLuint shadowWidth, GLuint shadowHeight,
 	linear = lin;
 	exponent = exp;
 
+	nearPlane = near;
 	farPlane = far;
 
+	requestedShadowWidth = shadowWidth;
+	requestedShadowHeight = shadowHeight;
+
+	visible = true;
+	CalcRange();
+
 	float aspect = (float)shadowWidth / (float)shadowHeight;
 	lightProj = glm::perspective(glm::radians(90.0f), aspect, near, far);
 
+	// the base class made a 2D map; point lights live in the shared omni atlas instead
+	delete shadowMap;
 	shadowMap = new OmniShadowMap();
-	shadowMap->Init(shadowWidth, shadowHeight);
+	if (!shadowMap->Init(shadowWidth, shadowHeight))
+	{
+		printf("Omni light at (%.1f, %.1f, %.1f) will cast no shadows\n", xPos, yPos, zPos);
+	}
 }
 
 void PointLight::UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLocation,
 						GLuint diffuseIntensityLocation, GLuint positionLocation,
 						GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation)
 {
-	glUniform3f(ambientColourLocation, colour.x, colour.y, colour.z);
-	glUniform1f(ambientIntensityLocation, ambientIntensity);
-	glUniform1f(diffuseIntensityLocation, diffuseIntensity);
-
-	glUniform3f(positionLocation, position.x, position.y, position.z);
-	glUniform1f(constantLocation, constant);
-	glUniform1f(linearLocation, linear);
-	glUniform1f(exponentLocation, exponent);
+	Shader::Uniform3f(ambientColourLocation, colour.x, colour.y, colour.z);
+	Shader::Uniform1f(ambientIntensityLocation, ambientIntensity);
+	Shader::Uniform1f(diffuseIntensityLocation, diffuseIntensity);
+
+	Shader::Uniform3f(positionLocation, position.x, position.y, position.z);
+	Shader::Uniform1f(constantLocation, constant);
+	Shader::Uniform1f(linearLocation, linear);
+	Shader::Uniform1f(exponentLocation, exponent);
+}
+
+void PointLight::SetShadowFilter(ShadowFilter filter)
+{
+	if (!shadowMap || shadowMap->GetFilter() == filter)
+	{
+		return;
+	}
+
+	// hand the old slot back before looking for one in an atlas of the new kind; ask for the
+	// original resolution, not the current map's, so switching back finds the same atlas size
+	delete shadowMap;
+	shadowMap = new OmniShadowMap(filter);
+	if (!shadowMap->Init(requestedShadowWidth, requestedShadowHeight))
+	{
+		printf("Omni light at (%.1f, %.1f, %.1f) will cast no shadows\n", position.x, position.y, position.z);
+	}
+}
+
+bool PointLight::HasShadowMap()
+{
+	return shadowMap && ((OmniShadowMap*)shadowMap)->HasSlot();
 }
 
 std::vector<glm::mat4> PointLight::CalculateLightTransform()
@@ -63,6 +110,44 @@ std::vector<glm::mat4> PointLight::CalculateLightTransform()
 	return lightMatrices;
 }
 
+void PointLight::CalcRange()
+{
+	// brightest channel over attenuation reaches the cutoff:
+	// exponent * d^2 + linear * d + constant = intensity / cutoff
+	GLfloat c = constant - GetIntensity() / LIGHT_INTENSITY_CUTOFF;
+
+	if (c >= 0.0f)
+	{
+		range = 0.0f;
+	}
+	else if (exponent > 0.0f) {
+		range = (-linear + sqrtf(linear * linear - 4.0f * exponent * c)) / (2.0f * exponent);
+	}
+	else if (linear > 0.0f) {
+		range = -c / linear;
+	}
+	else {
+		// no falloff, bounded only by the shadow far plane
+		range = farPlane;
+	}
+}
+
+GLfloat PointLight::GetIntensity()
+{
+	return glm::max(colour.x, glm::max(colour.y, colour.z)) * (ambientIntensity + diffuseIntensity + MAX_SPECULAR_INTENSITY);
+}
+
+void PointLight::GetBounds(glm::vec3& centre, GLfloat& radius)
+{
+	centre = position;
+	radius = range;
+}
+
+GLfloat PointLight::GetNearPlane()
+{
+	return nearPlane;
+}
+
 GLfloat PointLight::GetFarPlane()
 {
 	return farPlane;
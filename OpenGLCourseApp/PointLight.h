@@ -20,10 +20,30 @@ public:
 				GLuint diffuseIntensityLocation, GLuint positionLocation,
 				GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation);
 
+	void SetShadowFilter(ShadowFilter filter);
+
+	// false when every atlas slot was taken; the light is then drawn without shadows
+	bool HasShadowMap();
+
 	std::vector<glm::mat4> CalculateLightTransform();
+	GLfloat GetNearPlane();
 	GLfloat GetFarPlane();
 	glm::vec3 GetPosition();
 
+	// distance from the light at which it stops contributing anything visible
+	GLfloat GetRange() { return range; }
+
+	// the brightest colour channel at unit attenuation, counting the brightest specular highlight
+	GLfloat GetIntensity();
+
+	// a sphere around everything the light can reach
+	virtual void GetBounds(glm::vec3& centre, GLfloat& radius);
+	virtual bool IsOn() { return true; }
+
+	// whether anything the light reaches can be seen this frame; set by the renderer
+	void SetVisible(bool isVisible) { visible = isVisible; }
+	bool IsVisible() { return visible; }
+
 	~PointLight();
 
 protected:
@@ -31,7 +51,15 @@ protected:
 
 	GLfloat constant, linear, exponent;  // parameters to calculate attenuation
 
-	GLfloat farPlane;
+	GLfloat nearPlane, farPlane;
+
+	// resolution asked for at construction; the map itself takes the size of whichever atlas has room
+	GLuint requestedShadowWidth, requestedShadowHeight;
+
+	GLfloat range;
+	bool visible;
+
+	void CalcRange();
 
 };
 
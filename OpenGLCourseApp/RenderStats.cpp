@@ -0,0 +1,167 @@
+#include "pch.h"
+#include "RenderStats.h"
+
+RenderStats::RenderStats()
+{
+	enabled = false;
+	reportInterval = 2.0f;
+	lastReport = 0.0f;
+
+	frames = 0;
+	frameTimeTotal = 0.0f;
+
+	shadowFaces = 0;
+	shadowFacesTotal = 0;
+	culledFaceDraws = 0;
+	culledFaceDrawsTotal = 0;
+	triangles = 0;
+	trianglesTotal = 0;
+	occludedObjects = 0;
+	occludedObjectsTotal = 0;
+	culledLights = 0;
+	culledLightsTotal = 0;
+	skippedUniforms = 0;
+	skippedUniformsTotal = 0;
+
+	timerQueries[0] = 0;
+	timerQueries[1] = 0;
+	timerIndex = 0;
+	gpuFrames = 0;
+	gpuTimeTotal = 0.0;
+
+	fragmentQueries[0] = 0;
+	fragmentQueries[1] = 0;
+	fragmentPixels[0] = 0;
+	fragmentPixels[1] = 0;
+	fragmentIndex = 0;
+	fragmentFrames = 0;
+	fragmentsPerPixelTotal = 0.0;
+}
+
+RenderStats::RenderStats(GLfloat reportInterval) : RenderStats()
+{
+	this->reportInterval = reportInterval;
+}
+
+void RenderStats::BeginFrame()
+{
+	shadowFaces = 0;
+	culledFaceDraws = 0;
+	triangles = 0;
+	occludedObjects = 0;
+	culledLights = 0;
+	skippedUniforms = 0;
+}
+
+void RenderStats::BeginGpuTimer()
+{
+	// created lazily, stats objects exist before the GL context does
+	if (!timerQueries[0])
+	{
+		glGenQueries(2, timerQueries);
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, timerQueries[timerIndex]);
+}
+
+void RenderStats::EndGpuTimer()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+
+	timerIndex = 1 - timerIndex;
+
+	GLint available = 0;
+	glGetQueryObjectiv(timerQueries[timerIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available)
+	{
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(timerQueries[timerIndex], GL_QUERY_RESULT, &elapsed);
+		gpuTimeTotal += elapsed / 1000000.0;
+		gpuFrames++;
+	}
+}
+
+void RenderStats::BeginFragmentQuery()
+{
+	if (!fragmentQueries[0])
+	{
+		glGenQueries(2, fragmentQueries);
+	}
+
+	glBeginQuery(GL_SAMPLES_PASSED, fragmentQueries[fragmentIndex]);
+}
+
+void RenderStats::EndFragmentQuery(GLuint pixelCount)
+{
+	glEndQuery(GL_SAMPLES_PASSED);
+
+	fragmentPixels[fragmentIndex] = pixelCount;
+	fragmentIndex = 1 - fragmentIndex;
+
+	GLint available = 0;
+	glGetQueryObjectiv(fragmentQueries[fragmentIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available && fragmentPixels[fragmentIndex])
+	{
+		GLuint64 samples = 0;
+		glGetQueryObjectui64v(fragmentQueries[fragmentIndex], GL_QUERY_RESULT, &samples);
+		fragmentsPerPixelTotal += (double)samples / fragmentPixels[fragmentIndex];
+		fragmentFrames++;
+	}
+}
+
+void RenderStats::EndFrame(GLfloat now, GLfloat deltaTime)
+{
+	frames++;
+	frameTimeTotal += deltaTime;
+	shadowFacesTotal += shadowFaces;
+	culledFaceDrawsTotal += culledFaceDraws;
+	trianglesTotal += triangles;
+	occludedObjectsTotal += occludedObjects;
+	culledLightsTotal += culledLights;
+	skippedUniformsTotal += skippedUniforms;
+
+	if (now - lastReport < reportInterval)
+	{
+		return;
+	}
+
+	if (enabled && frames > 0)
+	{
+		printf("frame %.2f ms | lighting pass %.3f ms GPU | shadow faces %.1f | culled face draws %.1f | triangles %.0f | occluded objects %.1f | culled lights %.1f | skipped uniform uploads %.1f | shaded fragments per pixel %.2f\n",
+			frameTimeTotal / frames * 1000.0f,
+			gpuFrames ? gpuTimeTotal / gpuFrames : 0.0,
+			(GLfloat)shadowFacesTotal / frames,
+			(GLfloat)culledFaceDrawsTotal / frames,
+			(GLfloat)trianglesTotal / frames,
+			(GLfloat)occludedObjectsTotal / frames,
+			(GLfloat)culledLightsTotal / frames,
+			(GLfloat)skippedUniformsTotal / frames,
+			fragmentFrames ? fragmentsPerPixelTotal / fragmentFrames : 0.0);
+	}
+
+	lastReport = now;
+	frames = 0;
+	frameTimeTotal = 0.0f;
+	shadowFacesTotal = 0;
+	culledFaceDrawsTotal = 0;
+	trianglesTotal = 0;
+	occludedObjectsTotal = 0;
+	culledLightsTotal = 0;
+	skippedUniformsTotal = 0;
+	gpuFrames = 0;
+	gpuTimeTotal = 0.0;
+	fragmentFrames = 0;
+	fragmentsPerPixelTotal = 0.0;
+}
+
+RenderStats::~RenderStats()
+{
+	if (timerQueries[0])
+	{
+		glDeleteQueries(2, timerQueries);
+	}
+	if (fragmentQueries[0])
+	{
+		glDeleteQueries(2, fragmentQueries);
+	}
+}
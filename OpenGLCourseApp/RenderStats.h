@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+// Per-frame counters, averaged and printed to the console once per report interval.
+// The GPU timer brackets the lighting pass to compare shading cost between modes, and the
+// fragment query counts how many fragments the lighting shader ran for, per screen pixel.
+class RenderStats
+{
+public:
+	RenderStats();
+	RenderStats(GLfloat reportInterval);
+
+	void BeginFrame();
+	void EndFrame(GLfloat now, GLfloat deltaTime);
+
+	void BeginGpuTimer();
+	void EndGpuTimer();
+
+	void BeginFragmentQuery();
+	void EndFragmentQuery(GLuint pixelCount);
+
+	void Toggle() { enabled = !enabled; }
+
+	GLuint shadowFaces;
+	GLuint culledFaceDraws;
+	GLuint triangles;
+	GLuint occludedObjects;
+	GLuint culledLights;
+	GLuint skippedUniforms;
+
+	~RenderStats();
+
+private:
+	bool enabled;
+
+	GLfloat reportInterval;
+	GLfloat lastReport;
+
+	unsigned int frames;
+	GLfloat frameTimeTotal;
+	unsigned long long shadowFacesTotal;
+	unsigned long long culledFaceDrawsTotal;
+	unsigned long long trianglesTotal;
+	unsigned long long occludedObjectsTotal;
+	unsigned long long culledLightsTotal;
+	unsigned long long skippedUniformsTotal;
+
+	// two queries in flight so reading last frame's result never stalls
+	GLuint timerQueries[2];
+	unsigned int timerIndex;
+	unsigned int gpuFrames;
+	double gpuTimeTotal;
+
+	GLuint fragmentQueries[2];
+	GLuint fragmentPixels[2];
+	unsigned int fragmentIndex;
+	unsigned int fragmentFrames;
+	double fragmentsPerPixelTotal;
+};
+
@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "Shader.h"
 
+bool Shader::parallelCompile = false;
+Shader* Shader::boundShader = nullptr;
+GLuint Shader::skippedUploads = 0;
 
 Shader::Shader()
 {
@@ -10,6 +13,9 @@ Shader::Shader()
 
 	pointLightCount = 0;
 	spotLightCount = 0;
+
+	pendingShaderCount = 0;
+	linked = false;
 }
 
 void Shader::CreateFromString(const char* vertexCode, const char* fragmentCode)
@@ -17,6 +23,56 @@ void Shader::CreateFromString(const char* vertexCode, const char* fragmentCode)
 	CompileShader(vertexCode, fragmentCode);
 }
 
+void Shader::CreateFromStringAsync(const char* vertexCode, const char* fragmentCode)
+{
+	shaderID = glCreateProgram();
+
+	if (!shaderID) {
+		std::cout << "Error creating shader program!" << std::endl;
+		return;
+	}
+
+	AddShader(shaderID, vertexCode, GL_VERTEX_SHADER);
+	AddShader(shaderID, fragmentCode, GL_FRAGMENT_SHADER);
+
+	CompileProgram(false);
+}
+
+bool Shader::IsReady()
+{
+	if (pendingShaderCount)
+	{
+		// querying the status of a program still compiling would block until it is done
+		if (parallelCompile)
+		{
+			GLint done = 0;
+			glGetProgramiv(shaderID, GL_COMPLETION_STATUS_KHR, &done);
+			if (!done)
+			{
+				return false;
+			}
+		}
+
+		FinishProgram();
+	}
+
+	return linked;
+}
+
+bool Shader::EnableParallelCompile()
+{
+	if (!GLEW_KHR_parallel_shader_compile)
+	{
+		return false;
+	}
+
+	// let the driver pick how many threads
+	glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	parallelCompile = true;
+
+	return true;
+}
+
 void Shader::CreateFromFiles(const char* vertexLocation, const char* fragmentLocation)
 {
 	std::string vertexString = ReadFile(vertexLocation);
@@ -40,6 +96,14 @@ void Shader::CreateFromFiles(const char* vertexLocation, const char* geometryLoc
 	CompileShader(vertexCode, geometryCode, fragmentCode);
 }
 
+void Shader::CreateFromFile(const char* computeLocation)
+{
+	std::string computeString = ReadFile(computeLocation);
+	const char* computeCode = computeString.c_str();
+
+	CompileShader(computeCode);
+}
+
 std::string Shader::ReadFile(const char* fileLocation)
 {
 	std::string content;
@@ -73,7 +137,7 @@ void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
 	AddShader(shaderID, vertexCode, GL_VERTEX_SHADER);
 	AddShader(shaderID, fragmentCode, GL_FRAGMENT_SHADER);
 
-	CompileProgram();
+	CompileProgram(true);
 }
 
 void Shader::CompileShader(const char* vertexCode, const char* geometryCode, const char* fragmentCode)
@@ -89,7 +153,21 @@ void Shader::CompileShader(const char* vertexCode, const char* geometryCode, con
 	AddShader(shaderID, geometryCode, GL_GEOMETRY_SHADER);
 	AddShader(shaderID, fragmentCode, GL_FRAGMENT_SHADER);
 
-	CompileProgram();
+	CompileProgram(true);
+}
+
+void Shader::CompileShader(const char* computeCode)
+{
+	shaderID = glCreateProgram();
+
+	if (!shaderID) {
+		std::cout << "Error creating shader program!" << std::endl;
+		return;
+	}
+
+	AddShader(shaderID, computeCode, GL_COMPUTE_SHADER);
+
+	CompileProgram(true);
 }
 
 void Shader::Validate()
@@ -107,12 +185,39 @@ void Shader::Validate()
 	}
 }
 
-void Shader::CompileProgram()
+// Status queries wait for the driver, so the checks and uniform lookups live in FinishProgram,
+// which runs now when waiting or once IsReady finds the program built
+void Shader::CompileProgram(bool wait)
+{
+	glLinkProgram(shaderID);   // generate executable in GPU
+
+	if (wait)
+	{
+		FinishProgram();
+	}
+}
+
+void Shader::FinishProgram()
 {
 	GLint result = 0;
 	GLchar eLog[1024]{};
 
-	glLinkProgram(shaderID);   // generate executable in GPU
+	for (size_t i = 0; i < pendingShaderCount; i++)
+	{
+		glGetShaderiv(pendingShaders[i], GL_COMPILE_STATUS, &result);
+		if (!result)
+		{
+			GLint shaderType = 0;
+			glGetShaderiv(pendingShaders[i], GL_SHADER_TYPE, &shaderType);
+			glGetShaderInfoLog(pendingShaders[i], sizeof(eLog), NULL, eLog);
+			printf("Error compiling %d shader: %s\n", shaderType, eLog);
+		}
+
+		glDetachShader(shaderID, pendingShaders[i]);
+		glDeleteShader(pendingShaders[i]);
+	}
+	pendingShaderCount = 0;
+
 	glGetProgramiv(shaderID, GL_LINK_STATUS, &result);
 	if (!result)
 	{
@@ -121,106 +226,186 @@ void Shader::CompileProgram()
 		return;
 	}
 
-	uniformModel = glGetUniformLocation(shaderID, "model");
-	uniformProjection = glGetUniformLocation(shaderID, "projection");
-	uniformView = glGetUniformLocation(shaderID, "view");
+	linked = true;
+
+	// one pass over the active uniforms instead of asking the driver for every name below;
+	// arrays the program doesn't have are skipped whole and left at -1
+	uniformTable.Build(shaderID);
+
+	uniformValues.assign((uniformTable.GetMaxLocation() + 1) * 16, 0.0f);
+	uniformKnown.assign(uniformTable.GetMaxLocation() + 1, 0);
+
+	memset(uniformPointLight, 0xFF, sizeof(uniformPointLight));
+	memset(uniformSpotLight, 0xFF, sizeof(uniformSpotLight));
+	memset(uniformOmniShadowMaps, 0xFF, sizeof(uniformOmniShadowMaps));
+	memset(uniformLightMatrices, 0xFF, sizeof(uniformLightMatrices));
+	memset(uniformOmniShadowAtlases, 0xFF, sizeof(uniformOmniShadowAtlases));
+	memset(uniformOmniMomentAtlases, 0xFF, sizeof(uniformOmniMomentAtlases));
+
+	uniformModel = uniformTable.Find("model");
+	uniformProjection = uniformTable.Find("projection");
+	uniformView = uniformTable.Find("view");
 
-	uniformDirectionalLight.uniformColour = glGetUniformLocation(shaderID, "directionalLight.base.colour");
-	uniformDirectionalLight.uniformAmbientIntensity = glGetUniformLocation(shaderID, "directionalLight.base.ambientIntensity");
-	uniformDirectionalLight.uniformDiffuseIntensity = glGetUniformLocation(shaderID, "directionalLight.base.diffuseIntensity");
-	uniformDirectionalLight.uniformDirection = glGetUniformLocation(shaderID, "directionalLight.direction");
+	uniformDirectionalLight.uniformColour = uniformTable.Find("directionalLight.base.colour");
+	uniformDirectionalLight.uniformAmbientIntensity = uniformTable.Find("directionalLight.base.ambientIntensity");
+	uniformDirectionalLight.uniformDiffuseIntensity = uniformTable.Find("directionalLight.base.diffuseIntensity");
+	uniformDirectionalLight.uniformDirection = uniformTable.Find("directionalLight.direction");
 
-	uniformSpecularIntensity = glGetUniformLocation(shaderID, "material.specularIntensity");
-	uniformShininess = glGetUniformLocation(shaderID, "material.shininess");
-	uniformEyePostion = glGetUniformLocation(shaderID, "eyePosition");
+	uniformSpecularIntensity = uniformTable.Find("material.specularIntensity");
+	uniformShininess = uniformTable.Find("material.shininess");
+	uniformEyePostion = uniformTable.Find("eyePosition");
 
-	uniformPointLightCount = glGetUniformLocation(shaderID, "pointLightCount");
-	uniformSpotLightCount = glGetUniformLocation(shaderID, "spotLightCount");
+	uniformPointLightCount = uniformTable.Find("pointLightCount");
+	uniformSpotLightCount = uniformTable.Find("spotLightCount");
 
-	for (size_t i = 0; i < MAX_POINT_LIGHTS; i++)
+	if (uniformTable.HasArray("pointLights"))
 	{
-		char locBuff[100] = { '\0' };
+		for (size_t i = 0; i < MAX_POINT_LIGHTS; i++)
+		{
+			char locBuff[100] = { '\0' };
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.colour", i);
-		uniformPointLight[i].uniformColour = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.colour", i);
+			uniformPointLight[i].uniformColour = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.ambientIntensity", i);
-		uniformPointLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.ambientIntensity", i);
+			uniformPointLight[i].uniformAmbientIntensity = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.diffuseIntensity", i);
-		uniformPointLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.diffuseIntensity", i);
+			uniformPointLight[i].uniformDiffuseIntensity = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].position", i);
-		uniformPointLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "pointLights[%d].position", i);
+			uniformPointLight[i].uniformPosition = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].constant", i);
-		uniformPointLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "pointLights[%d].constant", i);
+			uniformPointLight[i].uniformConstant = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].linear", i);
-		uniformPointLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "pointLights[%d].linear", i);
+			uniformPointLight[i].uniformLinear = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].exponent", i);
-		uniformPointLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "pointLights[%d].exponent", i);
+			uniformPointLight[i].uniformExponent = uniformTable.Find(locBuff);
+		}
 	}
 
-	uniformSpotLightCount = glGetUniformLocation(shaderID, "spotLightCount");
+	uniformSpotLightCount = uniformTable.Find("spotLightCount");
 
-	for (size_t i = 0; i < MAX_SPOT_LIGHTS; i++)
+	if (uniformTable.HasArray("spotLights"))
 	{
-		char locBuff[100] = { '\0' };
+		for (size_t i = 0; i < MAX_SPOT_LIGHTS; i++)
+		{
+			char locBuff[100] = { '\0' };
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.colour", i);
-		uniformSpotLight[i].uniformColour = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.colour", i);
+			uniformSpotLight[i].uniformColour = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.ambientIntensity", i);
-		uniformSpotLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.ambientIntensity", i);
+			uniformSpotLight[i].uniformAmbientIntensity = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.diffuseIntensity", i);
-		uniformSpotLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.diffuseIntensity", i);
+			uniformSpotLight[i].uniformDiffuseIntensity = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.position", i);
-		uniformSpotLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.position", i);
+			uniformSpotLight[i].uniformPosition = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.constant", i);
-		uniformSpotLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.constant", i);
+			uniformSpotLight[i].uniformConstant = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.linear", i);
-		uniformSpotLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.linear", i);
+			uniformSpotLight[i].uniformLinear = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.exponent", i);
-		uniformSpotLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.exponent", i);
+			uniformSpotLight[i].uniformExponent = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].direction", i);
-		uniformSpotLight[i].uniformDirection = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "spotLights[%d].direction", i);
+			uniformSpotLight[i].uniformDirection = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].edge", i);
-		uniformSpotLight[i].uniformEdge = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "spotLights[%d].edge", i);
+			uniformSpotLight[i].uniformEdge = uniformTable.Find(locBuff);
+		}
 	}
 
-	uniformTexture = glGetUniformLocation(shaderID, "theTexture");
-	uniformDirectionalLightTransform = glGetUniformLocation(shaderID, "directionalLightTransform");
-	uniformDirectionalShadowMap = glGetUniformLocation(shaderID, "directionalShadowMap");
+	uniformTexture = uniformTable.Find("theTexture");
+	uniformDirectionalLightTransform = uniformTable.Find("directionalLightTransform");
+	uniformDirectionalShadowMap = uniformTable.Find("directionalShadowMap");
+	uniformDirectionalShadowMoments = uniformTable.Find("directionalShadowMoments");
+	uniformDirectionalShadowFilter = uniformTable.Find("directionalShadowFilter");
+
+	uniformOmniLightPos = uniformTable.Find("lightPos");
+	uniformFarPlane = uniformTable.Find("farPlane");
+	uniformFaceMask = uniformTable.Find("faceMask");
+	uniformLightMatrix = uniformTable.Find("lightMatrix");
+	uniformLayerBase = uniformTable.Find("layerBase");
+	uniformBlurDirection = uniformTable.Find("blurDirection");
+
+	uniformViewProjection = uniformTable.Find("viewProjection");
+	uniformOcclusionViewProjection = uniformTable.Find("occlusionViewProjection");
+	uniformCullSphere = uniformTable.Find("cullSphere");
+	uniformOcclusion = uniformTable.Find("occlusion");
+	uniformCommandBase = uniformTable.Find("commandBase");
+	uniformCountBase = uniformTable.Find("countBase");
+	uniformSourceLevel = uniformTable.Find("sourceLevel");
+
+	uniformGBufferAlbedo = uniformTable.Find("gBufferAlbedo");
+	uniformGBufferSurface = uniformTable.Find("gBufferSurface");
+	uniformGBufferDepth = uniformTable.Find("gBufferDepth");
+	uniformLightTiles = uniformTable.Find("lightTiles");
+	uniformTileSize = uniformTable.Find("tileSize");
+	uniformInverseViewProjection = uniformTable.Find("inverseViewProjection");
+
+	if (uniformTable.HasArray("lightMatrices"))
+	{
+		for (size_t i = 0; i < 6; i++)
+		{
+			char locBuff[100] = { '\0' };
 
-	uniformOmniLightPos = glGetUniformLocation(shaderID, "lightPos");
-	uniformFarPlane = glGetUniformLocation(shaderID, "farPlane");
+			snprintf(locBuff, sizeof(locBuff), "lightMatrices[%d]", i);
+			uniformLightMatrices[i] = uniformTable.Find(locBuff);
+		}
+	}
 
-	for (size_t i = 0; i < 6; i++)
+	if (uniformTable.HasArray("omniShadowMaps"))
 	{
-		char locBuff[100] = { '\0' };
+		for (size_t i = 0; i < MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS; i++)
+		{
+			char locBuff[100] = { '\0' };
+
+			snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].atlas", i);
+			uniformOmniShadowMaps[i].atlas = uniformTable.Find(locBuff);
+
+			snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].cubeIndex", i);
+			uniformOmniShadowMaps[i].cubeIndex = uniformTable.Find(locBuff);
+
+			snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].filter", i);
+			uniformOmniShadowMaps[i].filter = uniformTable.Find(locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "lightMatrices[%d]", i);
-		uniformLightMatrices[i] = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].nearPlane", i);
+			uniformOmniShadowMaps[i].nearPlane = uniformTable.Find(locBuff);
+
+			snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].farPlane", i);
+			uniformOmniShadowMaps[i].farPlane = uniformTable.Find(locBuff);
+		}
 	}
 
-	for (size_t i = 0; i < MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS; i++)
+	if (uniformTable.HasArray("omniShadowAtlases"))
 	{
-		char locBuff[100] = { '\0' };
+		for (size_t i = 0; i < MAX_DEPTH_SHADOW_ATLASES; i++)
+		{
+			char locBuff[100] = { '\0' };
+
+			snprintf(locBuff, sizeof(locBuff), "omniShadowAtlases[%d]", i);
+			uniformOmniShadowAtlases[i] = uniformTable.Find(locBuff);
+		}
+	}
 
-		snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].shadowMap", i);
-		uniformOmniShadowMaps[i].shadowMap = glGetUniformLocation(shaderID, locBuff);
+	if (uniformTable.HasArray("omniMomentAtlases"))
+	{
+		for (size_t i = 0; i < MAX_MOMENT_SHADOW_ATLASES; i++)
+		{
+			char locBuff[100] = { '\0' };
 
-		snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].farPlane", i);
-		uniformOmniShadowMaps[i].farPlane = glGetUniformLocation(shaderID, locBuff);
+			snprintf(locBuff, sizeof(locBuff), "omniMomentAtlases[%d]", i);
+			uniformOmniMomentAtlases[i] = uniformTable.Find(locBuff);
+		}
 	}
 }
 
@@ -284,85 +469,324 @@ GLuint Shader::GetFarPlaneLocation()
 	return uniformFarPlane;
 }
 
+GLuint Shader::GetFaceMaskLocation()
+{
+	return uniformFaceMask;
+}
+
+GLuint Shader::GetLayerBaseLocation()
+{
+	return uniformLayerBase;
+}
+
+GLuint Shader::GetBlurDirectionLocation()
+{
+	return uniformBlurDirection;
+}
+
+GLuint Shader::GetViewProjectionLocation()
+{
+	return uniformViewProjection;
+}
+
+GLuint Shader::GetOcclusionViewProjectionLocation()
+{
+	return uniformOcclusionViewProjection;
+}
+
+GLuint Shader::GetCullSphereLocation()
+{
+	return uniformCullSphere;
+}
+
+GLuint Shader::GetOcclusionLocation()
+{
+	return uniformOcclusion;
+}
+
+GLuint Shader::GetCommandBaseLocation()
+{
+	return uniformCommandBase;
+}
+
+GLuint Shader::GetCountBaseLocation()
+{
+	return uniformCountBase;
+}
+
+GLuint Shader::GetSourceLevelLocation()
+{
+	return uniformSourceLevel;
+}
+
 void Shader::SetDirectionalLight(DirectionalLight * dLight)
 {
 	dLight->UseLight(uniformDirectionalLight.uniformAmbientIntensity, uniformDirectionalLight.uniformColour,
 		uniformDirectionalLight.uniformDiffuseIntensity, uniformDirectionalLight.uniformDirection);
+
+	Uniform1i(uniformDirectionalShadowFilter, dLight->GetShadowMap()->GetFilter());
 }
 
-void Shader::SetPointLights(PointLight * pLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset)
+unsigned int Shader::SetPointLights(PointLight * pLight, unsigned int lightCount, unsigned int offset)
 {
 	if (lightCount > MAX_POINT_LIGHTS) lightCount = MAX_POINT_LIGHTS;
 
-	glUniform1i(uniformPointLightCount, lightCount);
-
-	for (size_t i = 0; i < lightCount; i++)
+	unsigned int uploaded = 0;
+	for (size_t light = 0; light < lightCount; light++)
 	{
-		pLight[i].UseLight(uniformPointLight[i].uniformAmbientIntensity, uniformPointLight[i].uniformColour,
+		if (!pLight[light].IsVisible())
+		{
+			continue;
+		}
+
+		size_t i = uploaded++;
+		pLight[light].UseLight(uniformPointLight[i].uniformAmbientIntensity, uniformPointLight[i].uniformColour,
 			uniformPointLight[i].uniformDiffuseIntensity, uniformPointLight[i].uniformPosition,
 			uniformPointLight[i].uniformConstant, uniformPointLight[i].uniformLinear, uniformPointLight[i].uniformExponent);
 
-		pLight[i].GetShadowMap()->Read(GL_TEXTURE0 + textureUnit + i);
-		glUniform1i(uniformOmniShadowMaps[i + offset].shadowMap, textureUnit + i);
-		glUniform1f(uniformOmniShadowMaps[i + offset].farPlane, pLight[i].GetFarPlane());
+		OmniShadowMap* shadowMap = (OmniShadowMap*)pLight[light].GetShadowMap();
+		Uniform1i(uniformOmniShadowMaps[i + offset].atlas, shadowMap->GetAtlasIndex());
+		Uniform1i(uniformOmniShadowMaps[i + offset].cubeIndex, shadowMap->GetCubeIndex());
+		Uniform1i(uniformOmniShadowMaps[i + offset].filter, shadowMap->GetFilter());
+		Uniform1f(uniformOmniShadowMaps[i + offset].nearPlane, pLight[light].GetNearPlane());
+		Uniform1f(uniformOmniShadowMaps[i + offset].farPlane, pLight[light].GetFarPlane());
 	}
+
+	Uniform1i(uniformPointLightCount, uploaded);
+
+	return uploaded;
 }
 
-void Shader::SetSpotLights(SpotLight * sLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset)
+unsigned int Shader::SetSpotLights(SpotLight * sLight, unsigned int lightCount, unsigned int offset)
 {
 	if (lightCount > MAX_SPOT_LIGHTS) lightCount = MAX_SPOT_LIGHTS;
 
-	glUniform1i(uniformSpotLightCount, lightCount);
-
-	for (size_t i = 0; i < lightCount; i++)
+	unsigned int uploaded = 0;
+	for (size_t light = 0; light < lightCount; light++)
 	{
-		sLight[i].UseLight(uniformSpotLight[i].uniformAmbientIntensity, uniformSpotLight[i].uniformColour,
+		if (!sLight[light].IsVisible())
+		{
+			continue;
+		}
+
+		size_t i = uploaded++;
+		sLight[light].UseLight(uniformSpotLight[i].uniformAmbientIntensity, uniformSpotLight[i].uniformColour,
 						uniformSpotLight[i].uniformDiffuseIntensity, uniformSpotLight[i].uniformPosition, uniformSpotLight[i].uniformDirection,
 						uniformSpotLight[i].uniformConstant, uniformSpotLight[i].uniformLinear, uniformSpotLight[i].uniformExponent,
 						uniformSpotLight[i].uniformEdge);
 
-		sLight[i].GetShadowMap()->Read(GL_TEXTURE0 + textureUnit + i);
-		glUniform1i(uniformOmniShadowMaps[i + offset].shadowMap, textureUnit + i);
-		glUniform1f(uniformOmniShadowMaps[i + offset].farPlane, sLight[i].GetFarPlane());
+		OmniShadowMap* shadowMap = (OmniShadowMap*)sLight[light].GetShadowMap();
+		Uniform1i(uniformOmniShadowMaps[i + offset].atlas, shadowMap->GetAtlasIndex());
+		Uniform1i(uniformOmniShadowMaps[i + offset].cubeIndex, shadowMap->GetCubeIndex());
+		Uniform1i(uniformOmniShadowMaps[i + offset].filter, shadowMap->GetFilter());
+		Uniform1f(uniformOmniShadowMaps[i + offset].nearPlane, sLight[light].GetNearPlane());
+		Uniform1f(uniformOmniShadowMaps[i + offset].farPlane, sLight[light].GetFarPlane());
+	}
+
+	Uniform1i(uniformSpotLightCount, uploaded);
+
+	return uploaded;
+}
+
+void Shader::SetOmniShadowAtlas(ShadowFilter filter, GLuint atlasIndex, GLuint textureUnit)
+{
+	// depth atlases are read through shadow samplers, moment atlases through plain ones
+	if (filter == SHADOW_FILTER_VSM)
+	{
+		Uniform1i(uniformOmniMomentAtlases[atlasIndex], textureUnit);
+	}
+	else {
+		Uniform1i(uniformOmniShadowAtlases[atlasIndex], textureUnit);
 	}
 }
 
 void Shader::SetTexture(GLuint textureUnit)
 {
-	glUniform1i(uniformTexture, textureUnit);
+	Uniform1i(uniformTexture, textureUnit);
 }
 
-void Shader::SetDirectionalShadowMap(GLuint textureUnit)
+void Shader::SetDirectionalShadowMap(GLuint textureUnit, GLuint momentsTextureUnit)
 {
-	glUniform1i(uniformDirectionalShadowMap, textureUnit);
+	Uniform1i(uniformDirectionalShadowMap, textureUnit);
+	Uniform1i(uniformDirectionalShadowMoments, momentsTextureUnit);
 }
 
 void Shader::SetDirectionalLightTransform(glm::mat4 * lTransform)
 {
-	glUniformMatrix4fv(uniformDirectionalLightTransform, 1, GL_FALSE, glm::value_ptr(*lTransform));
+	UniformMatrix4fv(uniformDirectionalLightTransform, *lTransform);
 }
 
 void Shader::SetLightMatrices(std::vector<glm::mat4> lightMatrices)
 {
 	for (size_t i = 0; i < 6; i++)
 	{
-		glUniformMatrix4fv(uniformLightMatrices[i], 1, GL_FALSE, glm::value_ptr(lightMatrices[i]));
+		UniformMatrix4fv(uniformLightMatrices[i], lightMatrices[i]);
+	}
+}
+
+void Shader::SetLightMatrix(glm::mat4 * lightMatrix)
+{
+	UniformMatrix4fv(uniformLightMatrix, *lightMatrix);
+}
+
+void Shader::SetGBuffer(GLuint albedoUnit, GLuint surfaceUnit, GLuint depthUnit)
+{
+	Uniform1i(uniformGBufferAlbedo, albedoUnit);
+	Uniform1i(uniformGBufferSurface, surfaceUnit);
+	Uniform1i(uniformGBufferDepth, depthUnit);
+}
+
+void Shader::SetLightTiles(GLuint textureUnit, GLuint tileSize)
+{
+	Uniform1i(uniformLightTiles, textureUnit);
+	Uniform1i(uniformTileSize, tileSize);
+}
+
+void Shader::SetInverseViewProjection(glm::mat4* inverseViewProjection)
+{
+	UniformMatrix4fv(uniformInverseViewProjection, *inverseViewProjection);
+}
+
+void Shader::SetObjectLights(const GLuint* lightIndices, GLuint lightCount)
+{
+	// -1 ends the list
+	GLint lights[MAX_OBJECT_LIGHTS] = { -1, -1, -1, -1 };
+	for (size_t i = 0; i < lightCount && i < MAX_OBJECT_LIGHTS; i++)
+	{
+		lights[i] = lightIndices[i];
 	}
+
+	glVertexAttribI4i(OBJECT_LIGHTS_ATTRIBUTE, lights[0], lights[1], lights[2], lights[3]);
 }
 
 void Shader::UseShader()
 {
 	glUseProgram(shaderID);
+	boundShader = this;
+}
+
+void Shader::Rebind(Shader* shader)
+{
+	if (shader)
+	{
+		shader->UseShader();
+	}
+	else {
+		glUseProgram(0);
+		boundShader = nullptr;
+	}
+}
+
+GLuint Shader::TakeSkippedUploads()
+{
+	GLuint skipped = skippedUploads;
+	skippedUploads = 0;
+
+	return skipped;
+}
+
+bool Shader::ShadowUniform(GLint location, const void* value, size_t size)
+{
+	// locations outside the reflected range, such as -1, go to GL as they always did
+	if (location < 0 || (size_t)location >= uniformKnown.size())
+	{
+		return true;
+	}
+
+	GLfloat* slot = &uniformValues[location * 16];
+	if (uniformKnown[location] && memcmp(slot, value, size) == 0)
+	{
+		skippedUploads++;
+		return false;
+	}
+
+	memcpy(slot, value, size);
+	uniformKnown[location] = 1;
+
+	return true;
+}
+
+void Shader::Uniform1i(GLint location, GLint value)
+{
+	if (!boundShader || boundShader->ShadowUniform(location, &value, sizeof(value)))
+	{
+		glUniform1i(location, value);
+	}
+}
+
+void Shader::Uniform1ui(GLint location, GLuint value)
+{
+	if (!boundShader || boundShader->ShadowUniform(location, &value, sizeof(value)))
+	{
+		glUniform1ui(location, value);
+	}
+}
+
+void Shader::Uniform1f(GLint location, GLfloat value)
+{
+	if (!boundShader || boundShader->ShadowUniform(location, &value, sizeof(value)))
+	{
+		glUniform1f(location, value);
+	}
+}
+
+void Shader::Uniform2f(GLint location, GLfloat x, GLfloat y)
+{
+	GLfloat value[2] = { x, y };
+	if (!boundShader || boundShader->ShadowUniform(location, value, sizeof(value)))
+	{
+		glUniform2f(location, x, y);
+	}
+}
+
+void Shader::Uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z)
+{
+	GLfloat value[3] = { x, y, z };
+	if (!boundShader || boundShader->ShadowUniform(location, value, sizeof(value)))
+	{
+		glUniform3f(location, x, y, z);
+	}
+}
+
+void Shader::Uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+{
+	GLfloat value[4] = { x, y, z, w };
+	if (!boundShader || boundShader->ShadowUniform(location, value, sizeof(value)))
+	{
+		glUniform4f(location, x, y, z, w);
+	}
+}
+
+void Shader::UniformMatrix4fv(GLint location, const glm::mat4& value)
+{
+	if (!boundShader || boundShader->ShadowUniform(location, glm::value_ptr(value), sizeof(value)))
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+	}
 }
 
 void Shader::ClearShader()
 {
+	for (size_t i = 0; i < pendingShaderCount; i++)
+	{
+		glDeleteShader(pendingShaders[i]);
+	}
+	pendingShaderCount = 0;
+	linked = false;
+
 	if (shaderID != 0)
 	{
 		glDeleteProgram(shaderID);
 		shaderID = 0;
 	}
 
+	if (boundShader == this)
+	{
+		boundShader = nullptr;
+	}
+	uniformValues.clear();
+	uniformKnown.clear();
+
 	uniformModel = 0;
 	uniformProjection = 0;
 }
@@ -380,18 +804,9 @@ void Shader::AddShader(GLuint theProgram, const GLchar* shaderCode, GLenum shade
 	glShaderSource(theShader, 1, theCode, codeLength);
 	glCompileShader(theShader);
 
-	GLint result = 0;
-	GLchar eLog[1024]{};
-
-	glGetShaderiv(theShader, GL_COMPILE_STATUS, &result);
-	if (!result)
-	{
-		glGetShaderInfoLog(theShader, sizeof(eLog), NULL, eLog);
-		printf("Error compiling %d shader: %s\n", shaderType, eLog);
-		return;
-	}
-
+	// the compile status is checked after linking, so several shaders can compile at once
 	glAttachShader(theProgram, theShader);
+	pendingShaders[pendingShaderCount++] = theShader;
 }
 
 Shader::~Shader()
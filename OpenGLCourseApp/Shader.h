@@ -10,6 +10,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "CommonValues.h"
+#include "UniformTable.h"
 
 #include "DirectionalLight.h"
 #include "PointLight.h"
@@ -23,6 +24,16 @@ public:
 	void CreateFromString(const char* vertexCode, const char* fragmentCode);
 	void CreateFromFiles(const char* vertexLocation, const char* fragmentLocation);
 	void CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation);
+	void CreateFromFile(const char* computeLocation);
+
+	// submits the compile and link without waiting on either; IsReady polls for the result
+	void CreateFromStringAsync(const char* vertexCode, const char* fragmentCode);
+
+	// false while the driver is still building the program, or if it failed to build
+	bool IsReady();
+
+	// lets the driver compile on its own threads, if GL_KHR_parallel_shader_compile is there
+	static bool EnableParallelCompile();
 
 	void Validate();
 
@@ -40,29 +51,93 @@ public:
 	GLuint GetEyePositionLocation();
 	GLuint GetOmniLightPosLocation();
 	GLuint GetFarPlaneLocation();
+	GLuint GetFaceMaskLocation();
+	GLuint GetLayerBaseLocation();
+	GLuint GetBlurDirectionLocation();
+	GLuint GetViewProjectionLocation();
+	GLuint GetOcclusionViewProjectionLocation();
+	GLuint GetCullSphereLocation();
+	GLuint GetOcclusionLocation();
+	GLuint GetCommandBaseLocation();
+	GLuint GetCountBaseLocation();
+	GLuint GetSourceLevelLocation();
 
 	void SetDirectionalLight(DirectionalLight* dLight);
-	void SetPointLights(PointLight* pLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset);
-	void SetSpotLights(SpotLight* sLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset);
+	// only visible lights are uploaded, packed to the front; returns how many were
+	unsigned int SetPointLights(PointLight* pLight, unsigned int lightCount, unsigned int offset);
+	unsigned int SetSpotLights(SpotLight* sLight, unsigned int lightCount, unsigned int offset);
+	void SetOmniShadowAtlas(ShadowFilter filter, GLuint atlasIndex, GLuint textureUnit);
 	void SetTexture(GLuint textureUnit);
-	void SetDirectionalShadowMap(GLuint textureUnit);
+	void SetDirectionalShadowMap(GLuint textureUnit, GLuint momentsTextureUnit);
 	void SetDirectionalLightTransform(glm::mat4* lTransform);
 	void SetLightMatrices(std::vector<glm::mat4> lightMatrices);
+	void SetLightMatrix(glm::mat4* lightMatrix);
+	void SetGBuffer(GLuint albedoUnit, GLuint surfaceUnit, GLuint depthUnit);
+	void SetLightTiles(GLuint textureUnit, GLuint tileSize);
+	void SetInverseViewProjection(glm::mat4* inverseViewProjection);
+
+	// indices into the uploaded lights, point lights first, then spot lights. They are the
+	// current value of the object lights vertex attribute, not program state, so they hold for
+	// any bound shader until the next call; instanced batch draws read their own from a buffer.
+	static void SetObjectLights(const GLuint* lightIndices, GLuint lightCount);
 
 	void UseShader();
 	void ClearShader();
 
+	// Uniform uploads to the bound shader. Every shader keeps a copy of the values it was last
+	// given and skips the GL call when a value is unchanged, so bind shaders with UseShader or
+	// Rebind, never glUseProgram, or the copy stops matching the program.
+	static void Uniform1i(GLint location, GLint value);
+	static void Uniform1ui(GLint location, GLuint value);
+	static void Uniform1f(GLint location, GLfloat value);
+	static void Uniform2f(GLint location, GLfloat x, GLfloat y);
+	static void Uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z);
+	static void Uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+	static void UniformMatrix4fv(GLint location, const glm::mat4& value);
+
+	// binds a shader saved from GetBoundShader, or no program for nullptr
+	static Shader* GetBoundShader() { return boundShader; }
+	static void Rebind(Shader* shader);
+
+	// uploads skipped since the last call
+	static GLuint TakeSkippedUploads();
+
 	~Shader();
 
 private:
 	int pointLightCount;
 	int spotLightCount;
 
+	// shaders attached to a link that hasn't been checked yet
+	GLuint pendingShaders[3];
+	GLuint pendingShaderCount;
+	bool linked;
+
+	static bool parallelCompile;
+
+	UniformTable uniformTable;
+
+	// the last value uploaded to each location, 16 floats a slot, compared bit for bit
+	std::vector<GLfloat> uniformValues;
+	std::vector<GLubyte> uniformKnown;
+
+	static Shader* boundShader;
+	static GLuint skippedUploads;
+
+	// false when the location already holds the value, which then needs no upload
+	bool ShadowUniform(GLint location, const void* value, size_t size);
+
 	GLuint shaderID, uniformProjection, uniformModel, uniformView, uniformEyePostion,
 		uniformSpecularIntensity, uniformShininess,
 		uniformTexture,
-		uniformDirectionalLightTransform, uniformDirectionalShadowMap,
-		uniformOmniLightPos, uniformFarPlane;
+		uniformDirectionalLightTransform, uniformDirectionalShadowMap, uniformDirectionalShadowMoments,
+		uniformOmniLightPos, uniformFarPlane,
+		uniformFaceMask, uniformLightMatrix, uniformLayerBase,
+		uniformBlurDirection, uniformDirectionalShadowFilter,
+		uniformViewProjection, uniformOcclusionViewProjection, uniformCullSphere, uniformOcclusion,
+		uniformCommandBase, uniformCountBase, uniformSourceLevel,
+		uniformGBufferAlbedo, uniformGBufferSurface, uniformGBufferDepth,
+		uniformLightTiles, uniformTileSize, uniformInverseViewProjection;
 
 	GLuint uniformLightMatrices[6];
 
@@ -103,14 +178,22 @@ private:
 	} uniformSpotLight[MAX_SPOT_LIGHTS];
 
 	struct {
-		GLuint shadowMap;
+		GLuint atlas;
+		GLuint cubeIndex;
+		GLuint filter;
+		GLuint nearPlane;
 		GLuint farPlane;
 	} uniformOmniShadowMaps[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
 
+	GLuint uniformOmniShadowAtlases[MAX_DEPTH_SHADOW_ATLASES];
+	GLuint uniformOmniMomentAtlases[MAX_MOMENT_SHADOW_ATLASES];
+
 	void CompileShader(const char* vertexCode, const char* fragmentCode);
 	void CompileShader(const char* vertexCode, const char* geometryCode, const char* fragmentCode);
+	void CompileShader(const char* computeCode);
 	void AddShader(GLuint theProgram, const GLchar* shaderCode, GLenum shaderType);
 
-	void CompileProgram();
+	void CompileProgram(bool wait);
+	void FinishProgram();
 };
 
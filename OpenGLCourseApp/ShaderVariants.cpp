@@ -0,0 +1,107 @@
+#include "pch.h"
+#include "ShaderVariants.h"
+
+
+ShaderVariants::ShaderVariants()
+{
+	fallback = nullptr;
+}
+
+void ShaderVariants::Init(const char* vertexLocation, const char* fragmentLocation)
+{
+	ClearVariants();
+
+	Shader reader;
+	vertexSource = reader.ReadFile(vertexLocation);
+	fragmentSource = reader.ReadFile(fragmentLocation);
+
+	fallback = new Shader();
+	fallback->CreateFromString(vertexSource.c_str(), fragmentSource.c_str());
+}
+
+void ShaderVariants::Prepare(const ShaderFeatures& features)
+{
+	FindVariant(features);
+}
+
+Shader* ShaderVariants::GetVariant(const ShaderFeatures& features)
+{
+	Shader* variant = FindVariant(features);
+
+	return variant->IsReady() ? variant : fallback;
+}
+
+Shader* ShaderVariants::FindVariant(const ShaderFeatures& features)
+{
+	GLuint key = MakeKey(features);
+
+	std::map<GLuint, Shader*>::iterator found = variants.find(key);
+	if (found != variants.end())
+	{
+		return found->second;
+	}
+
+	std::string defines = MakeDefines(features);
+	std::string vertexCode = InjectDefines(vertexSource, defines);
+	std::string fragmentCode = InjectDefines(fragmentSource, defines);
+
+	Shader* variant = new Shader();
+	variant->CreateFromStringAsync(vertexCode.c_str(), fragmentCode.c_str());
+	variants[key] = variant;
+
+	return variant;
+}
+
+void ShaderVariants::ClearVariants()
+{
+	for (std::map<GLuint, Shader*>::iterator it = variants.begin(); it != variants.end(); ++it)
+	{
+		delete it->second;
+	}
+	variants.clear();
+
+	delete fallback;
+	fallback = nullptr;
+}
+
+GLuint ShaderVariants::MakeKey(const ShaderFeatures& features)
+{
+	// 4 bits per light count is plenty for MAX_POINT_LIGHTS and MAX_SPOT_LIGHTS
+	return features.pointLights | (features.spotLights << 4) | (features.directionalShadowFilter << 8);
+}
+
+std::string ShaderVariants::MakeDefines(const ShaderFeatures& features)
+{
+	GLuint objectLightSlots = features.pointLights + features.spotLights;
+	if (objectLightSlots > MAX_OBJECT_LIGHTS)
+	{
+		objectLightSlots = MAX_OBJECT_LIGHTS;
+	}
+
+	char defines[256] = { '\0' };
+	snprintf(defines, sizeof(defines),
+		"#define POINT_LIGHT_COUNT %d\n"
+		"#define SPOT_LIGHT_COUNT %d\n"
+		"#define OBJECT_LIGHT_SLOTS %d\n"
+		"#define DIRECTIONAL_SHADOW_FILTER %d\n",
+		features.pointLights, features.spotLights, objectLightSlots, features.directionalShadowFilter);
+
+	return defines;
+}
+
+std::string ShaderVariants::InjectDefines(const std::string& source, const std::string& defines)
+{
+	// #version has to stay first; #define may come before #extension, which is a directive too
+	size_t lineEnd = source.find('\n');
+	if (lineEnd == std::string::npos)
+	{
+		return source;
+	}
+
+	return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	ClearVariants();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <GL/glew.h>
+
+#include "Shader.h"
+#include "ShadowMap.h"
+
+// What a variant is compiled for. Each becomes a #define, so the compiler can unroll the light
+// loops and drop the branches the variant never takes.
+struct ShaderFeatures
+{
+	GLuint pointLights;
+	GLuint spotLights;
+	ShadowFilter directionalShadowFilter;
+};
+
+// Variants of one vertex/fragment pair, compiled the first time their feature set is asked for
+// and kept by a key packed from the features. Sources are read once.
+// Variants build in the background; until one is ready, GetVariant hands out the fallback, the
+// same sources without defines, which reads everything from uniforms and covers every feature set.
+class ShaderVariants
+{
+public:
+	ShaderVariants();
+
+	// compiles the fallback, waiting on it
+	void Init(const char* vertexLocation, const char* fragmentLocation);
+
+	// starts building a variant ahead of its first use
+	void Prepare(const ShaderFeatures& features);
+
+	Shader* GetVariant(const ShaderFeatures& features);
+
+	size_t GetVariantCount() { return variants.size(); }
+
+	void ClearVariants();
+
+	~ShaderVariants();
+
+private:
+	std::string vertexSource, fragmentSource;
+
+	std::map<GLuint, Shader*> variants;
+	Shader* fallback;
+
+	Shader* FindVariant(const ShaderFeatures& features);
+
+	static GLuint MakeKey(const ShaderFeatures& features);
+	static std::string MakeDefines(const ShaderFeatures& features);
+	static std::string InjectDefines(const std::string& source, const std::string& defines);
+};
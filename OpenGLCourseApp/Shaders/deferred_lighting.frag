@@ -0,0 +1,349 @@
+#version 330
+#extension GL_ARB_texture_cube_map_array : require
+
+out vec4 colour;
+
+const int MAX_POINT_LIGHTS = 3;
+const int MAX_SPOT_LIGHTS = 3;
+const int MAX_DEPTH_SHADOW_ATLASES = 2;
+const int MAX_MOMENT_SHADOW_ATLASES = 1;
+
+const int SHADOW_FILTER_PCF = 0;
+const int SHADOW_FILTER_VSM = 1;
+
+struct Light
+{
+	vec3 colour;
+	float ambientIntensity;
+	float diffuseIntensity;
+};
+
+struct DirectionalLight 
+{
+	Light base;
+	vec3 direction;
+};
+
+struct PointLight
+{
+	Light base;
+	vec3 position;
+	float constant;
+	float linear;
+	float exponent;
+};
+
+struct SpotLight
+{
+	PointLight base;
+	vec3 direction;
+	float edge;
+};
+
+struct OmniShadowMap
+{
+	int atlas;
+	int cubeIndex;
+	int filter;
+	float nearPlane;
+	float farPlane;
+};
+
+struct Material
+{
+	float specularIntensity;
+	float shininess;
+};
+
+uniform int pointLightCount;
+uniform int spotLightCount;
+
+uniform DirectionalLight directionalLight;
+uniform PointLight pointLights[MAX_POINT_LIGHTS];
+uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
+
+uniform sampler2D theTexture;
+uniform sampler2DShadow directionalShadowMap;
+uniform sampler2D directionalShadowMoments;
+uniform int directionalShadowFilter;
+uniform OmniShadowMap omniShadowMaps[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+uniform samplerCubeArrayShadow omniShadowAtlases[MAX_DEPTH_SHADOW_ATLASES];
+uniform samplerCubeArray omniMomentAtlases[MAX_MOMENT_SHADOW_ATLASES];
+
+uniform vec3 eyePosition;
+
+// the surface being lit, rebuilt from the G-buffer in main
+vec3 Normal;
+vec3 FragPos;
+vec4 DirectionalLightSpacePos;
+Material material;
+
+uniform sampler2D gBufferAlbedo;
+uniform sampler2D gBufferSurface;
+uniform sampler2D gBufferDepth;
+uniform mat4 inverseViewProjection;
+uniform mat4 directionalLightTransform;
+
+// one bit per light that can reach a tile, point lights first
+uniform usampler2D lightTiles;
+uniform int tileSize;
+
+vec3 sampleOffsetDirections[20] = vec3[]
+(
+	vec3(1, 1, 1), vec3(1, -1, 1), vec3(-1, -1, 1), vec3(-1, 1, 1),
+	vec3(1, 1, -1), vec3(1, -1, -1), vec3(-1, -1, -1), vec3(-1, 1, -1),
+	vec3(1, 1, 0), vec3(1, -1, 0), vec3(-1, -1, 0), vec3(-1, 1, 0),
+	vec3(1, 0, 1), vec3(-1, 0, 1), vec3(1, 0, -1), vec3(-1, 0, -1),
+	vec3(0, 1, 1), vec3(0, -1, 1), vec3(0, -1, -1), vec3(0, 1, -1)
+);
+
+// Chebyshev upper bound on the fraction of light reaching depth t, with light bleeding trimmed
+float CalcVarianceShadowFactor(vec2 moments, float t)
+{
+	if (t <= moments.x)
+	{
+		return 0.0;
+	}
+
+	float variance = max(moments.y - moments.x * moments.x, 0.00002);
+	float d = t - moments.x;
+	float pMax = variance / (variance + d * d);
+	pMax = clamp((pMax - 0.2) / 0.8, 0.0, 1.0);
+
+	return 1.0 - pMax;
+}
+
+float CalcDirectionalShadowFactor(DirectionalLight light)
+{
+	vec3 projCoords = DirectionalLightSpacePos.xyz / DirectionalLightSpacePos.w;
+	projCoords = (projCoords * 0.5) + 0.5;
+
+	float current = projCoords.z;
+
+	if (directionalShadowFilter == SHADOW_FILTER_VSM)
+	{
+		if (current > 1.0)
+		{
+			return 0.0;
+		}
+
+		return CalcVarianceShadowFactor(texture(directionalShadowMoments, projCoords.xy).rg, current);
+	}
+
+	vec3 normal = normalize(Normal);
+	vec3 lightDir = normalize(light.direction);
+
+	float bias = max(0.05 * (1 - dot(normal, lightDir)), 0.005);
+
+	float shadow = 0.0;
+
+	// each comparison fetch already filters 2x2 texels in hardware
+	vec2 texelSize = 1.0 / textureSize(directionalShadowMap, 0);
+	for (int x = -1; x <= 1; ++x)
+	{
+		for (int y = -1; y <= 1; ++y)
+		{
+			shadow += 1.0 - texture(directionalShadowMap, vec3(projCoords.xy + vec2(x, y) * texelSize, current - bias));
+		}
+	}
+
+	shadow /= 9.0;
+
+	if (projCoords.z > 1.0)
+	{
+		shadow = 0.0;
+	}
+
+	return shadow;
+}
+
+// GLSL 3.30 only allows constant sampler array indices, hence the branches
+float SampleOmniShadowAtlas(int atlas, vec4 coord, float depthRef)
+{
+	if (atlas == 0)
+	{
+		return texture(omniShadowAtlases[0], coord, depthRef);
+	}
+
+	return texture(omniShadowAtlases[1], coord, depthRef);
+}
+
+// window-space depth a cube face's perspective projection gives a point at this offset from the light
+float CalcCubeFaceDepth(vec3 fragToLight, float nearPlane, float farPlane)
+{
+	vec3 absVec = abs(fragToLight);
+	float viewZ = max(absVec.x, max(absVec.y, absVec.z));
+
+	float ndcZ = (farPlane + nearPlane) / (farPlane - nearPlane) - (2.0 * farPlane * nearPlane) / ((farPlane - nearPlane) * viewZ);
+	return ndcZ * 0.5 + 0.5;
+}
+
+float CalcOmniShadowFactor(PointLight light, int shadowIndex)
+{
+	// no atlas had a slot for this light's map
+	if (omniShadowMaps[shadowIndex].atlas < 0)
+	{
+		return 0.0;
+	}
+
+	vec3 fragToLight = FragPos - light.position;
+	float current = length(fragToLight);
+
+	if (omniShadowMaps[shadowIndex].filter == SHADOW_FILTER_VSM)
+	{
+		vec2 moments = texture(omniMomentAtlases[0], vec4(fragToLight, omniShadowMaps[shadowIndex].cubeIndex)).rg;
+		return CalcVarianceShadowFactor(moments, current / omniShadowMaps[shadowIndex].farPlane);
+	}
+
+	float shadow = 0.0;
+	float bias = 0.05;
+	float samples = 20;
+
+	float viewDistance = length(eyePosition - FragPos);
+	float diskRadius = (1.0 + (viewDistance/omniShadowMaps[shadowIndex].farPlane)) / 25.0;
+
+	// apply the bias along the ray in world units, then move it into the stored depth space
+	vec3 biasedFragToLight = fragToLight * max(current - bias, 0.0) / current;
+	float depthRef = CalcCubeFaceDepth(biasedFragToLight, omniShadowMaps[shadowIndex].nearPlane, omniShadowMaps[shadowIndex].farPlane);
+
+	for (int i = 0; i < samples; i++)
+	{
+		vec3 sampleDir = fragToLight + sampleOffsetDirections[i] * diskRadius;
+		shadow += 1.0 - SampleOmniShadowAtlas(omniShadowMaps[shadowIndex].atlas, vec4(sampleDir, omniShadowMaps[shadowIndex].cubeIndex), depthRef);
+	}
+
+	shadow /= float(samples);
+	return shadow;
+}
+
+vec4 CalcLightByDirection(Light light, vec3 direction, float shadowFactor)
+{
+	vec4 ambientColour = vec4(light.colour, 1.0f) * light.ambientIntensity;
+
+	float diffuseFactor = max(dot(normalize(Normal), normalize(direction)), 0.0f);
+	vec4 diffuseColour = vec4(light.colour, 1.0f) * light.diffuseIntensity * diffuseFactor;
+
+	vec4 specularColour = vec4(0, 0, 0, 0);
+
+	if (diffuseFactor > 0.0f)
+	{
+		vec3 fragToEye = normalize(eyePosition - FragPos);
+		vec3 reflectedVertex = normalize(reflect(direction, normalize(Normal)));
+
+		float specularFactor = dot(fragToEye, reflectedVertex);
+		if (specularFactor > 0.0f)
+		{
+			specularFactor = pow(specularFactor, material.shininess);
+			specularColour = vec4(light.colour * material.specularIntensity * specularFactor, 1.0f);
+		}
+	}
+
+	return (ambientColour + (1.0 - shadowFactor) * (diffuseColour + specularColour));
+}
+
+vec4 CalcDirectionalLight()
+{
+	float shadowFactor = CalcDirectionalShadowFactor(directionalLight);
+	return CalcLightByDirection(directionalLight.base, directionalLight.direction, shadowFactor);
+}
+
+vec4 CalcPointLight(PointLight pLight, int shadowIndex)
+{
+	vec3 direction = FragPos - pLight.position;
+	float distance = length(direction);
+	direction = normalize(direction);
+
+	float shadowFactor = CalcOmniShadowFactor(pLight, shadowIndex);
+
+	vec4 colour = CalcLightByDirection(pLight.base, direction, shadowFactor);
+	float attenuation = pLight.exponent * distance * distance +
+						pLight.linear * distance +
+						pLight.constant;
+	
+	return (colour / attenuation);
+}
+
+vec4 CalcSpotLight(SpotLight sLight, int shadowIndex)
+{
+	vec3 rayDirection = normalize(FragPos - sLight.base.position);
+	float slFactor = dot(rayDirection, sLight.direction);
+
+	if (slFactor > sLight.edge)
+	{
+		vec4 colour = CalcPointLight(sLight.base, shadowIndex);
+
+		return colour * (1.0f - (1.0f - slFactor)*(1.0f/(1.0f - sLight.edge)));
+	} else {
+		return vec4(0, 0, 0, 0);
+	}
+}
+
+vec4 CalcPointLights(uint lightMask)
+{
+	vec4 totalColour = vec4(0, 0, 0, 0);
+	for (int i = 0; i < pointLightCount; i++)
+	{
+		if ((lightMask & (1u << i)) != 0u)
+		{
+			totalColour += CalcPointLight(pointLights[i], i);
+		}
+	}
+
+	return totalColour;
+}
+
+vec4 CalcSpotLights(uint lightMask)
+{
+	vec4 totalColour = vec4(0, 0, 0, 0);
+	for (int i = 0; i < spotLightCount; i++)
+	{
+		if ((lightMask & (1u << (i + pointLightCount))) != 0u)
+		{
+			totalColour += CalcSpotLight(spotLights[i], i + pointLightCount);
+		}
+	}
+
+	return totalColour;
+}
+
+vec3 DecodeNormal(vec2 encoded)
+{
+	vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+
+	return normalize(n);
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+	// nothing was drawn here, the sky goes in afterwards
+	float depth = texelFetch(gBufferDepth, pixel, 0).r;
+	if (depth >= 1.0)
+	{
+		discard;
+	}
+
+	vec4 surface = texelFetch(gBufferSurface, pixel, 0);
+	Normal = DecodeNormal(surface.xy);
+	material.specularIntensity = surface.z;
+	material.shininess = surface.w;
+
+	vec2 uv = (vec2(pixel) + 0.5) / vec2(textureSize(gBufferDepth, 0));
+	vec4 position = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	FragPos = position.xyz / position.w;
+	DirectionalLightSpacePos = directionalLightTransform * vec4(FragPos, 1.0);
+
+	uint lightMask = texelFetch(lightTiles, pixel / tileSize, 0).r;
+
+	vec4 finalColour = CalcDirectionalLight();
+	finalColour += CalcPointLights(lightMask);
+	finalColour += CalcSpotLights(lightMask);
+
+	colour = texelFetch(gBufferAlbedo, pixel, 0) * finalColour;
+
+	// the scene's depth for the sky and next frame's occlusion tests
+	gl_FragDepth = depth;
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 330
+
+layout (location = 0) in vec3 pos;
+
+// a quad already in clip space covering the screen
+void main()
+{
+	gl_Position = vec4(pos.xy, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,6 @@
+#version 330
+
+// depth only, the colour buffer is masked while this runs
+void main()
+{
+}
\ No newline at end of file
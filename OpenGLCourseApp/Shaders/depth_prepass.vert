@@ -0,0 +1,15 @@
+#version 330
+
+layout (location = 0) in vec3 pos;
+
+uniform mat4 model;
+uniform mat4 projection;
+uniform mat4 view;
+
+// must match shader.vert bit for bit so the lighting pass can test with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(pos, 1.0);
+}
\ No newline at end of file
@@ -1,2 +1,12 @@
 #version 330
-void main() {}
+
+out vec4 moments;
+
+// only kept when the target has a colour attachment (variance shadow maps)
+void main()
+{
+	float depth = gl_FragCoord.z;
+	float dx = dFdx(depth);
+	float dy = dFdy(depth);
+	moments = vec4(depth, depth * depth + 0.25 * (dx * dx + dy * dy), 0.0, 0.0);
+}
@@ -0,0 +1,34 @@
+#version 330
+
+in vec2 TexCoord;
+in vec3 Normal;
+
+layout (location = 0) out vec4 albedo;
+layout (location = 1) out vec4 surface;
+
+struct Material
+{
+	float specularIntensity;
+	float shininess;
+};
+
+uniform sampler2D theTexture;
+uniform Material material;
+
+// octahedral mapping: the sphere folded onto a square, two channels per normal
+vec2 EncodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+
+	return n.xy;
+}
+
+void main()
+{
+	albedo = texture(theTexture, TexCoord);
+	surface = vec4(EncodeNormal(normalize(Normal)), material.specularIntensity, material.shininess);
+}
\ No newline at end of file
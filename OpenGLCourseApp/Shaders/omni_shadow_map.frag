@@ -2,12 +2,17 @@
 
 in vec4 FragPos;
 
+out vec4 moments;
+
 uniform vec3 lightPos;
 uniform float farPlane;
 
+// Depth atlases keep the rasterised depth as is (no gl_FragDepth, so early-Z stays on);
+// only variance atlases, which have a colour attachment, keep these distance moments.
 void main() 
 {
 	float distance = length(FragPos.xyz - lightPos);
 	distance = distance / farPlane;
-	gl_FragDepth = distance;
+
+	moments = vec4(distance, distance * distance, 0.0, 0.0);
 }
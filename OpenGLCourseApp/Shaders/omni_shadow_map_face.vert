@@ -0,0 +1,14 @@
+#version 330
+
+layout (location = 0) in vec3 pos;
+
+uniform mat4 model;
+uniform mat4 lightMatrix;
+
+out vec4 FragPos;
+
+void main()
+{
+	FragPos = model * vec4(pos, 1.0);
+	gl_Position = lightMatrix * FragPos;
+}
@@ -1,15 +1,37 @@
 #version 330
+#extension GL_ARB_texture_cube_map_array : require
 
 in vec4 vCol;
 in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragPos;
 in vec4 DirectionalLightSpacePos;
+flat in ivec4 ObjectLights;
 
 out vec4 colour;
 
 const int MAX_POINT_LIGHTS = 3;
 const int MAX_SPOT_LIGHTS = 3;
+const int MAX_DEPTH_SHADOW_ATLASES = 2;
+const int MAX_MOMENT_SHADOW_ATLASES = 1;
+const int MAX_OBJECT_LIGHTS = 4;
+
+const int SHADOW_FILTER_PCF = 0;
+const int SHADOW_FILTER_VSM = 1;
+
+// ShaderVariants defines these per variant; -1 leaves the value to a uniform set at draw time
+#ifndef POINT_LIGHT_COUNT
+#define POINT_LIGHT_COUNT -1
+#endif
+#ifndef SPOT_LIGHT_COUNT
+#define SPOT_LIGHT_COUNT -1
+#endif
+#ifndef OBJECT_LIGHT_SLOTS
+#define OBJECT_LIGHT_SLOTS MAX_OBJECT_LIGHTS
+#endif
+#ifndef DIRECTIONAL_SHADOW_FILTER
+#define DIRECTIONAL_SHADOW_FILTER -1
+#endif
 
 struct Light
 {
@@ -42,7 +64,10 @@ struct SpotLight
 
 struct OmniShadowMap
 {
-	samplerCube shadowMap;
+	int atlas;
+	int cubeIndex;
+	int filter;
+	float nearPlane;
 	float farPlane;
 };
 
@@ -52,16 +77,32 @@ struct Material
 	float shininess;
 };
 
+#if POINT_LIGHT_COUNT < 0
 uniform int pointLightCount;
+#else
+const int pointLightCount = POINT_LIGHT_COUNT;
+#endif
+#if SPOT_LIGHT_COUNT < 0
 uniform int spotLightCount;
+#else
+const int spotLightCount = SPOT_LIGHT_COUNT;
+#endif
 
 uniform DirectionalLight directionalLight;
 uniform PointLight pointLights[MAX_POINT_LIGHTS];
 uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
 
 uniform sampler2D theTexture;
-uniform sampler2D directionalShadowMap;
+uniform sampler2DShadow directionalShadowMap;
+uniform sampler2D directionalShadowMoments;
+#if DIRECTIONAL_SHADOW_FILTER < 0
+uniform int directionalShadowFilter;
+#else
+const int directionalShadowFilter = DIRECTIONAL_SHADOW_FILTER;
+#endif
 uniform OmniShadowMap omniShadowMaps[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+uniform samplerCubeArrayShadow omniShadowAtlases[MAX_DEPTH_SHADOW_ATLASES];
+uniform samplerCubeArray omniMomentAtlases[MAX_MOMENT_SHADOW_ATLASES];
 
 uniform Material material;
 
@@ -76,6 +117,22 @@ vec3 sampleOffsetDirections[20] = vec3[]
 	vec3(0, 1, 1), vec3(0, -1, 1), vec3(0, -1, -1), vec3(0, 1, -1)
 );
 
+// Chebyshev upper bound on the fraction of light reaching depth t, with light bleeding trimmed
+float CalcVarianceShadowFactor(vec2 moments, float t)
+{
+	if (t <= moments.x)
+	{
+		return 0.0;
+	}
+
+	float variance = max(moments.y - moments.x * moments.x, 0.00002);
+	float d = t - moments.x;
+	float pMax = variance / (variance + d * d);
+	pMax = clamp((pMax - 0.2) / 0.8, 0.0, 1.0);
+
+	return 1.0 - pMax;
+}
+
 float CalcDirectionalShadowFactor(DirectionalLight light)
 {
 	vec3 projCoords = DirectionalLightSpacePos.xyz / DirectionalLightSpacePos.w;
@@ -83,6 +140,16 @@ float CalcDirectionalShadowFactor(DirectionalLight light)
 
 	float current = projCoords.z;
 
+	if (directionalShadowFilter == SHADOW_FILTER_VSM)
+	{
+		if (current > 1.0)
+		{
+			return 0.0;
+		}
+
+		return CalcVarianceShadowFactor(texture(directionalShadowMoments, projCoords.xy).rg, current);
+	}
+
 	vec3 normal = normalize(Normal);
 	vec3 lightDir = normalize(light.direction);
 
@@ -90,13 +157,13 @@ float CalcDirectionalShadowFactor(DirectionalLight light)
 
 	float shadow = 0.0;
 
+	// each comparison fetch already filters 2x2 texels in hardware
 	vec2 texelSize = 1.0 / textureSize(directionalShadowMap, 0);
 	for (int x = -1; x <= 1; ++x)
 	{
 		for (int y = -1; y <= 1; ++y)
 		{
-			float pcfDepth = texture(directionalShadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-			shadow += current - bias > pcfDepth ? 1.0 : 0.0;
+			shadow += 1.0 - texture(directionalShadowMap, vec3(projCoords.xy + vec2(x, y) * texelSize, current - bias));
 		}
 	}
 
@@ -110,11 +177,44 @@ float CalcDirectionalShadowFactor(DirectionalLight light)
 	return shadow;
 }
 
+// GLSL 3.30 only allows constant sampler array indices, hence the branches
+float SampleOmniShadowAtlas(int atlas, vec4 coord, float depthRef)
+{
+	if (atlas == 0)
+	{
+		return texture(omniShadowAtlases[0], coord, depthRef);
+	}
+
+	return texture(omniShadowAtlases[1], coord, depthRef);
+}
+
+// window-space depth a cube face's perspective projection gives a point at this offset from the light
+float CalcCubeFaceDepth(vec3 fragToLight, float nearPlane, float farPlane)
+{
+	vec3 absVec = abs(fragToLight);
+	float viewZ = max(absVec.x, max(absVec.y, absVec.z));
+
+	float ndcZ = (farPlane + nearPlane) / (farPlane - nearPlane) - (2.0 * farPlane * nearPlane) / ((farPlane - nearPlane) * viewZ);
+	return ndcZ * 0.5 + 0.5;
+}
+
 float CalcOmniShadowFactor(PointLight light, int shadowIndex)
 {
+	// no atlas had a slot for this light's map
+	if (omniShadowMaps[shadowIndex].atlas < 0)
+	{
+		return 0.0;
+	}
+
 	vec3 fragToLight = FragPos - light.position;
 	float current = length(fragToLight);
 
+	if (omniShadowMaps[shadowIndex].filter == SHADOW_FILTER_VSM)
+	{
+		vec2 moments = texture(omniMomentAtlases[0], vec4(fragToLight, omniShadowMaps[shadowIndex].cubeIndex)).rg;
+		return CalcVarianceShadowFactor(moments, current / omniShadowMaps[shadowIndex].farPlane);
+	}
+
 	float shadow = 0.0;
 	float bias = 0.05;
 	float samples = 20;
@@ -122,14 +222,14 @@ float CalcOmniShadowFactor(PointLight light, int shadowIndex)
 	float viewDistance = length(eyePosition - FragPos);
 	float diskRadius = (1.0 + (viewDistance/omniShadowMaps[shadowIndex].farPlane)) / 25.0;
 
+	// apply the bias along the ray in world units, then move it into the stored depth space
+	vec3 biasedFragToLight = fragToLight * max(current - bias, 0.0) / current;
+	float depthRef = CalcCubeFaceDepth(biasedFragToLight, omniShadowMaps[shadowIndex].nearPlane, omniShadowMaps[shadowIndex].farPlane);
+
 	for (int i = 0; i < samples; i++)
 	{
-		float closest = texture(omniShadowMaps[shadowIndex].shadowMap, fragToLight + sampleOffsetDirections[i] * diskRadius).r;
-		closest *= omniShadowMaps[shadowIndex].farPlane;
-		if (current - bias > closest)
-		{
-			shadow += 1.0;
-		}		
+		vec3 sampleDir = fragToLight + sampleOffsetDirections[i] * diskRadius;
+		shadow += 1.0 - SampleOmniShadowAtlas(omniShadowMaps[shadowIndex].atlas, vec4(sampleDir, omniShadowMaps[shadowIndex].cubeIndex), depthRef);
 	}
 
 	shadow /= float(samples);
@@ -198,23 +298,33 @@ vec4 CalcSpotLight(SpotLight sLight, int shadowIndex)
 	}
 }
 
-vec4 CalcPointLights()
+// only the lights picked for the object being drawn, indexed point lights first
+vec4 CalcObjectLights()
 {
 	vec4 totalColour = vec4(0, 0, 0, 0);
-	for (int i = 0; i < pointLightCount; i++)
-	{
-		totalColour += CalcPointLight(pointLights[i], i);
-	}
 
-	return totalColour;
-}
-
-vec4 CalcSpotLights()
-{
-	vec4 totalColour = vec4(0, 0, 0, 0);
-	for (int i = 0; i < spotLightCount; i++)
+	// a constant trip count the compiler can unroll, with the end of the draw's list as an early out
+	for (int i = 0; i < OBJECT_LIGHT_SLOTS; i++)
 	{
-		totalColour += CalcSpotLight(spotLights[i], i + pointLightCount);
+		int light = ObjectLights[i];
+		if (light < 0)
+		{
+			break;
+		}
+
+#if SPOT_LIGHT_COUNT == 0
+		totalColour += CalcPointLight(pointLights[light], light);
+#elif POINT_LIGHT_COUNT == 0
+		totalColour += CalcSpotLight(spotLights[light], light);
+#else
+		if (light < pointLightCount)
+		{
+			totalColour += CalcPointLight(pointLights[light], light);
+		}
+		else {
+			totalColour += CalcSpotLight(spotLights[light - pointLightCount], light);
+		}
+#endif
 	}
 
 	return totalColour;
@@ -223,8 +333,7 @@ vec4 CalcSpotLights()
 void main()
 {
 	vec4 finalColour = CalcDirectionalLight();
-	finalColour += CalcPointLights();
-	finalColour += CalcSpotLights();
+	finalColour += CalcObjectLights();
 
 	colour = texture(theTexture, TexCoord) * finalColour;
 }
@@ -4,17 +4,24 @@ layout (location = 0) in vec3 pos;
 layout (location = 1) in vec2 tex;
 layout (location = 2) in vec3 norm;
 
+// the lights picked for this draw, -1 after the last
+layout (location = 3) in ivec4 drawLights;
+
 out vec4 vCol;
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragPos;
 out vec4 DirectionalLightSpacePos;
+flat out ivec4 ObjectLights;
 
 uniform mat4 model;
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 directionalLightTransform;
 
+// the depth pre-pass computes the same position; both must agree exactly
+invariant gl_Position;
+
 void main()
 {
 	gl_Position = projection * view * model * vec4(pos, 1.0);
@@ -27,4 +34,6 @@ void main()
 	Normal = mat3(transpose(inverse(model))) * norm;
 
 	FragPos = (model * vec4(pos, 1.0)).xyz;
+
+	ObjectLights = drawLights;
 }
@@ -0,0 +1,23 @@
+#version 330
+
+in vec2 TexCoord;
+
+out vec4 moments;
+
+uniform sampler2D shadowMoments;
+uniform vec2 blurDirection;
+
+// 7-tap gaussian, run once horizontally and once vertically
+const float weights[4] = float[](0.2270270, 0.1945946, 0.1216216, 0.0540540);
+
+void main()
+{
+	vec2 result = textureLod(shadowMoments, TexCoord, 0.0).rg * weights[0];
+	for (int i = 1; i < 4; i++)
+	{
+		result += textureLod(shadowMoments, TexCoord + blurDirection * i, 0.0).rg * weights[i];
+		result += textureLod(shadowMoments, TexCoord - blurDirection * i, 0.0).rg * weights[i];
+	}
+
+	moments = vec4(result, 0.0, 0.0);
+}
@@ -10,5 +10,6 @@ uniform mat4 view;
 void main()
 {
 	TexCoords = pos;
-	gl_Position = projection * view * vec4(pos, 1.0);
+	// on the far plane, so drawn last it only covers pixels nothing else has
+	gl_Position = (projection * view * vec4(pos, 1.0)).xyww;
 }
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "pch.h"
+#include "ShadowAtlas.h"
+
+ShadowAtlas::ShadowAtlas()
+{
+	FBO = 0;
+	shadowAtlas = 0;
+	momentAtlas = 0;
+	size = 0;
+	capacity = 0;
+	filter = SHADOW_FILTER_PCF;
+	momentsDirty = false;
+}
+
+bool ShadowAtlas::Init(GLuint size, GLuint capacity, ShadowFilter filter)
+{
+	if (!GLEW_ARB_texture_cube_map_array)
+	{
+		printf("Shadow atlas needs GL_ARB_texture_cube_map_array\n");
+		return false;
+	}
+
+	this->size = size;
+	this->capacity = capacity;
+	this->filter = filter;
+	slotUsed.assign(capacity, false);
+
+	glGenFramebuffers(1, &FBO);
+
+	glGenTextures(1, &shadowAtlas);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, shadowAtlas);
+	// plain hardware depth of each face's perspective projection, linearised by the lighting shader
+	glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, capacity * 6, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	if (filter == SHADOW_FILTER_VSM)
+	{
+		glGenTextures(1, &momentAtlas);
+		glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, momentAtlas);
+		glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_RG32F, size, size, capacity * 6, 0, GL_RG, GL_FLOAT, nullptr);
+
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP_ARRAY);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	AttachLayered();
+
+	if (filter == SHADOW_FILTER_VSM)
+	{
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	}
+	else {
+		glDrawBuffer(GL_NONE);
+	}
+	glReadBuffer(GL_NONE);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Framebuffer Error: %i\n", status);
+		return false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return true;
+}
+
+int ShadowAtlas::AllocateSlot()
+{
+	for (size_t i = 0; i < slotUsed.size(); i++)
+	{
+		if (!slotUsed[i])
+		{
+			slotUsed[i] = true;
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
+void ShadowAtlas::ReleaseSlot(int slot)
+{
+	if (slot >= 0 && slot < (int)slotUsed.size())
+	{
+		slotUsed[slot] = false;
+	}
+}
+
+GLuint ShadowAtlas::GetFreeSlots()
+{
+	GLuint freeSlots = 0;
+	for (size_t i = 0; i < slotUsed.size(); i++)
+	{
+		if (!slotUsed[i])
+		{
+			freeSlots++;
+		}
+	}
+
+	return freeSlots;
+}
+
+void ShadowAtlas::AttachLayered()
+{
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowAtlas, 0);
+	if (momentAtlas)
+	{
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentAtlas, 0);
+	}
+}
+
+void ShadowAtlas::AttachLayer(GLint layer)
+{
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowAtlas, 0, layer);
+	if (momentAtlas)
+	{
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentAtlas, 0, layer);
+	}
+}
+
+// Bind the whole array as a layered target; the geometry shader picks slot * 6 + face
+void ShadowAtlas::Write(int slot)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	ClearSlot(slot);
+	AttachLayered();
+
+	momentsDirty = true;
+}
+
+void ShadowAtlas::WriteFace(int slot, GLuint face)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	AttachLayer(slot * 6 + face);
+
+	GLfloat farDepth = 1.0f;
+	GLfloat farMoments[] = { 1.0f, 1.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_DEPTH, 0, &farDepth);
+	if (momentAtlas)
+	{
+		glClearBufferfv(GL_COLOR, 0, farMoments);
+	}
+
+	momentsDirty = true;
+}
+
+// A layered glClear would wipe every light's map, so only this slot's six layers are reset
+void ShadowAtlas::ClearSlot(int slot)
+{
+	GLfloat farDepth = 1.0f;
+	GLfloat farMoments[] = { 1.0f, 1.0f, 0.0f, 0.0f };
+
+	if (GLEW_ARB_clear_texture)
+	{
+		glClearTexSubImage(shadowAtlas, 0, 0, 0, slot * 6, size, size, 6, GL_DEPTH_COMPONENT, GL_FLOAT, &farDepth);
+		if (momentAtlas)
+		{
+			glClearTexSubImage(momentAtlas, 0, 0, 0, slot * 6, size, size, 6, GL_RG, GL_FLOAT, farMoments);
+		}
+		return;
+	}
+
+	for (GLuint face = 0; face < 6; face++)
+	{
+		AttachLayer(slot * 6 + face);
+		glClearBufferfv(GL_DEPTH, 0, &farDepth);
+		if (momentAtlas)
+		{
+			glClearBufferfv(GL_COLOR, 0, farMoments);
+		}
+	}
+}
+
+// Rebuild the moment mip chain once after all of this frame's omni passes
+void ShadowAtlas::Resolve()
+{
+	if (!momentAtlas || !momentsDirty)
+	{
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, momentAtlas);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP_ARRAY);
+	momentsDirty = false;
+}
+
+void ShadowAtlas::Read(GLenum textureUnit)
+{
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, momentAtlas ? momentAtlas : shadowAtlas);
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+	if (FBO)
+	{
+		glDeleteFramebuffers(1, &FBO);
+	}
+
+	if (shadowAtlas)
+	{
+		glDeleteTextures(1, &shadowAtlas);
+	}
+
+	if (momentAtlas)
+	{
+		glDeleteTextures(1, &momentAtlas);
+	}
+}
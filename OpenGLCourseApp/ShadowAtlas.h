@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "ShadowMap.h"
+
+// A cube map array shared by many omni lights. Every light owns one slot (six layers),
+// all slots are rendered through a single framebuffer and read through a single texture unit.
+// VSM atlases add a mipmapped array of distance moments next to the depth array.
+class ShadowAtlas
+{
+public:
+	ShadowAtlas();
+
+	bool Init(GLuint size, GLuint capacity, ShadowFilter filter);
+
+	int AllocateSlot();
+	void ReleaseSlot(int slot);
+
+	void Write(int slot);
+	void WriteFace(int slot, GLuint face);
+
+	void Resolve();
+
+	void Read(GLenum textureUnit);
+
+	GLuint GetSize() { return size; }
+	ShadowFilter GetFilter() { return filter; }
+	GLuint GetFreeSlots();
+
+	~ShadowAtlas();
+
+private:
+	GLuint FBO, shadowAtlas, momentAtlas;
+	GLuint size, capacity;
+
+	ShadowFilter filter;
+	bool momentsDirty;
+
+	std::vector<bool> slotUsed;
+
+	void ClearSlot(int slot);
+	void AttachLayer(GLint layer);
+	void AttachLayered();
+};
+
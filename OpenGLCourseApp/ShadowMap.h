@@ -3,6 +3,13 @@
 #include <stdio.h>
 #include <GL/glew.h>
 
+// How a light's shadow map is stored and filtered in the lighting shader
+enum ShadowFilter
+{
+	SHADOW_FILTER_PCF = 0,	// depth, several comparisons per fragment
+	SHADOW_FILTER_VSM = 1	// depth moments, one hardware-filtered fetch
+};
+
 class ShadowMap
 {
 public:
@@ -12,15 +19,20 @@ public:
 
 	virtual void Write();
 
+	virtual void Resolve() {}
+
 	virtual void Read(GLenum textureUnit);
 
 	GLuint GetShadowWidth() { return shadowWidth; }
 	GLuint GetShadowHeight() { return shadowHeight; }
+	ShadowFilter GetFilter() { return filter; }
 
-	~ShadowMap();
+	virtual ~ShadowMap();
 
 protected:
 	GLuint FBO, shadowMap;
 	GLuint shadowWidth, shadowHeight;
+
+	ShadowFilter filter;
 };
 
@@ -0,0 +1,154 @@
+#include "pch.h"
+#include "ShadowScheduler.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// every omni shadow pass renders all six faces of the cube
+static const GLuint FACES_PER_LIGHT = 6;
+
+ShadowScheduler::ShadowScheduler()
+{
+	faceBudget = 12;
+	maxStaleFrames = 30;
+	scheduledFaces = 0;
+	frame = 0;
+}
+
+ShadowScheduler::ShadowScheduler(GLuint faceBudget, GLuint maxStaleFrames)
+{
+	this->faceBudget = faceBudget;
+	this->maxStaleFrames = maxStaleFrames;
+	scheduledFaces = 0;
+	frame = 0;
+}
+
+void ShadowScheduler::AddLight(PointLight * light)
+{
+	LightEntry entry;
+	entry.light = light;
+	entry.lastPosition = light->GetPosition();
+	entry.lastUpdateFrame = 0;
+	entry.hasShadow = false;
+	entry.priority = 0.0f;
+
+	lights.push_back(entry);
+}
+
+// Forces every light to be re-rendered, e.g. after their shadow maps were reallocated
+void ShadowScheduler::InvalidateAll()
+{
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		lights[i].hasShadow = false;
+	}
+}
+
+GLfloat ShadowScheduler::CalcPriority(LightEntry& entry, glm::vec3 cameraPosition)
+{
+	// a light that has never been rendered has no usable map at all
+	if (!entry.hasShadow)
+	{
+		return FLT_MAX;
+	}
+
+	glm::vec3 position = entry.light->GetPosition();
+	GLfloat distance = glm::length(position - cameraPosition);
+	GLfloat farPlane = entry.light->GetFarPlane();
+
+	// rough screen-space influence: how large the shadowed volume looks from the camera
+	GLfloat influence = farPlane / std::max(distance, 1.0f);
+
+	GLfloat age = (GLfloat)(frame - entry.lastUpdateFrame);
+
+	// lights nearer the edge of their own range refresh less often
+	GLfloat staleLimit = std::max(1.0f, std::min((GLfloat)maxStaleFrames, distance / farPlane * maxStaleFrames));
+	if (age >= staleLimit)
+	{
+		influence *= 4.0f;
+	}
+
+	// a moved light casts shadows in the wrong place until it is re-rendered
+	if (position != entry.lastPosition)
+	{
+		influence *= 8.0f;
+	}
+
+	return influence * age;
+}
+
+std::vector<PointLight*> ShadowScheduler::Schedule(glm::vec3 cameraPosition)
+{
+	frame++;
+	scheduledFaces = 0;
+
+	std::vector<LightEntry*> candidates;
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		// nothing lit by an unseen light is on screen; its map just ages until it is seen again
+		if (!lights[i].light->IsVisible())
+		{
+			continue;
+		}
+
+		// a light that found no atlas slot has nowhere to render to
+		if (!lights[i].light->HasShadowMap())
+		{
+			continue;
+		}
+
+		lights[i].priority = CalcPriority(lights[i], cameraPosition);
+		candidates.push_back(&lights[i]);
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const LightEntry* a, const LightEntry* b) {
+		return a->priority > b->priority;
+	});
+
+	// maps that would otherwise be used past maxStaleFrames go first, over budget if need be;
+	// a light seen again after a while is refreshed on its first visible frame this way
+	std::vector<LightEntry*> forced, optional;
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		if (candidates[i]->hasShadow && frame - candidates[i]->lastUpdateFrame >= maxStaleFrames)
+		{
+			forced.push_back(candidates[i]);
+		}
+		else {
+			optional.push_back(candidates[i]);
+		}
+	}
+
+	std::vector<PointLight*> scheduled;
+	for (size_t i = 0; i < forced.size(); i++)
+	{
+		Refresh(forced[i], scheduled);
+	}
+
+	for (size_t i = 0; i < optional.size(); i++)
+	{
+		// always refresh at least one light so no map can starve
+		if (scheduledFaces + FACES_PER_LIGHT > faceBudget && !scheduled.empty())
+		{
+			break;
+		}
+
+		Refresh(optional[i], scheduled);
+	}
+
+	return scheduled;
+}
+
+void ShadowScheduler::Refresh(LightEntry* entry, std::vector<PointLight*>& scheduled)
+{
+	entry->lastPosition = entry->light->GetPosition();
+	entry->lastUpdateFrame = frame;
+	entry->hasShadow = true;
+
+	scheduled.push_back(entry->light);
+	scheduledFaces += FACES_PER_LIGHT;
+}
+
+ShadowScheduler::~ShadowScheduler()
+{
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "PointLight.h"
+
+// Decides which omni lights get their cube shadow map re-rendered this frame.
+// Each frame has a budget of cube faces; lights that moved, are close to the camera
+// or have gone stale the longest are refreshed first, the rest keep last frame's map.
+// Lights not visible this frame are never scheduled. A visible light whose map is
+// maxStaleFrames old is always refreshed, even past the budget, so no map in use is older.
+class ShadowScheduler
+{
+public:
+	ShadowScheduler();
+	ShadowScheduler(GLuint faceBudget, GLuint maxStaleFrames);
+
+	void AddLight(PointLight* light);
+	void InvalidateAll();
+
+	std::vector<PointLight*> Schedule(glm::vec3 cameraPosition);
+
+	GLuint GetScheduledFaces() { return scheduledFaces; }
+
+	~ShadowScheduler();
+
+private:
+	struct LightEntry {
+		PointLight* light;
+		glm::vec3 lastPosition;
+		unsigned int lastUpdateFrame;
+		bool hasShadow;
+		GLfloat priority;
+	};
+
+	std::vector<LightEntry> lights;
+
+	GLuint faceBudget;
+	GLuint maxStaleFrames;
+	GLuint scheduledFaces;
+	unsigned int frame;
+
+	GLfloat CalcPriority(LightEntry& entry, glm::vec3 cameraPosition);
+	void Refresh(LightEntry* entry, std::vector<PointLight*>& scheduled);
+};
+
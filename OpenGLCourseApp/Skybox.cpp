@@ -83,11 +83,12 @@ void Skybox::DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 	viewMatrix = glm::mat4(glm::mat3(viewMatrix));
 
 	glDepthMask(GL_FALSE);
+	glDepthFunc(GL_LEQUAL);
 
 	skyShader->UseShader();
 
-	glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
-	glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+	Shader::UniformMatrix4fv(uniformProjection, projectionMatrix);
+	Shader::UniformMatrix4fv(uniformView, viewMatrix);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
@@ -96,6 +97,7 @@ void Skybox::DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 
 	skyMesh->RenderMesh();
 
+	glDepthFunc(GL_LESS);
 	glDepthMask(GL_TRUE);
 }
 
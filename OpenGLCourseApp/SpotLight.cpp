@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "SpotLight.h"
 
+#include "Shader.h"
+
 
 SpotLight::SpotLight() : PointLight()
 {
@@ -30,25 +32,25 @@ void SpotLight::UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLo
 						GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation, 
 						GLuint edgeLocation)
 {
-	glUniform3f(ambientColourLocation, colour.x, colour.y, colour.z);
+	Shader::Uniform3f(ambientColourLocation, colour.x, colour.y, colour.z);
 
 	if (isOn)
 	{
-		glUniform1f(ambientIntensityLocation, ambientIntensity);
-		glUniform1f(diffuseIntensityLocation, diffuseIntensity);
+		Shader::Uniform1f(ambientIntensityLocation, ambientIntensity);
+		Shader::Uniform1f(diffuseIntensityLocation, diffuseIntensity);
 	}
 	else {
-		glUniform1f(ambientIntensityLocation, 0.0f);
-		glUniform1f(diffuseIntensityLocation, 0.0f);
+		Shader::Uniform1f(ambientIntensityLocation, 0.0f);
+		Shader::Uniform1f(diffuseIntensityLocation, 0.0f);
 	}
 
-	glUniform3f(positionLocation, position.x, position.y, position.z);
-	glUniform1f(constantLocation, constant);
-	glUniform1f(linearLocation, linear);
-	glUniform1f(exponentLocation, exponent);
+	Shader::Uniform3f(positionLocation, position.x, position.y, position.z);
+	Shader::Uniform1f(constantLocation, constant);
+	Shader::Uniform1f(linearLocation, linear);
+	Shader::Uniform1f(exponentLocation, exponent);
 
-	glUniform3f(directionLocation, direction.x, direction.y, direction.z);
-	glUniform1f(edgeLocation, procEdge);
+	Shader::Uniform3f(directionLocation, direction.x, direction.y, direction.z);
+	Shader::Uniform1f(edgeLocation, procEdge);
 }
 
 void SpotLight::SetFlash(glm::vec3 pos, glm::vec3 dir)
@@ -57,6 +59,28 @@ void SpotLight::SetFlash(glm::vec3 pos, glm::vec3 dir)
 	direction = dir;
 }
 
+void SpotLight::GetBounds(glm::vec3& centre, GLfloat& radius)
+{
+	// narrow cones: the sphere through the apex and the cap's rim;
+	// wide ones: the sphere around the cap's rim alone
+	GLfloat cosAngle = procEdge;
+	GLfloat sinAngle = sqrtf(glm::max(1.0f - cosAngle * cosAngle, 0.0f));
+
+	if (cosAngle >= 0.70710678f)
+	{
+		radius = range / (2.0f * cosAngle);
+		centre = position + direction * radius;
+	}
+	else if (cosAngle > 0.0f) {
+		radius = range * sinAngle;
+		centre = position + direction * (range * cosAngle);
+	}
+	else {
+		// wider than a hemisphere, as good as a point light
+		PointLight::GetBounds(centre, radius);
+	}
+}
+
 SpotLight::~SpotLight()
 {
 }
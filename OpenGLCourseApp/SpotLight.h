@@ -24,6 +24,13 @@ public:
 
 	void Toggle() { isOn = !isOn; }
 
+	// the smallest sphere around the cone rather than the whole range
+	void GetBounds(glm::vec3& centre, GLfloat& radius);
+	bool IsOn() { return isOn; }
+
+	glm::vec3 GetDirection() { return direction; }
+	GLfloat GetConeCos() { return procEdge; }
+
 	~SpotLight();
 
 private:
@@ -0,0 +1,148 @@
+#include "pch.h"
+#include "StaticBatch.h"
+
+#include <cmath>
+
+bool StaticBatch::GroupKey::operator<(const GroupKey& other) const
+{
+	// texture first so the draw list needs as few binds as possible
+	if (texture != other.texture) return texture < other.texture;
+	if (material != other.material) return material < other.material;
+	if (chunkX != other.chunkX) return chunkX < other.chunkX;
+	return chunkZ < other.chunkZ;
+}
+
+StaticBatch::StaticBatch()
+{
+	chunkSize = 16.0f;
+}
+
+StaticBatch::StaticBatch(GLfloat chunkSize)
+{
+	this->chunkSize = chunkSize;
+}
+
+void StaticBatch::Add(const GLfloat* vertices, unsigned int numOfVertices, const unsigned int* indices, unsigned int numOfIndices,
+					glm::mat4 model, Texture* texture, Material* material)
+{
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+	// the whole object goes into the chunk holding its centre
+	BoundingBox worldBounds;
+	for (size_t i = 0; i < numOfVertices; i += 8)
+	{
+		worldBounds.Expand(glm::vec3(model * glm::vec4(vertices[i], vertices[i + 1], vertices[i + 2], 1.0f)));
+	}
+	glm::vec3 centre = worldBounds.GetCentre();
+
+	GroupKey key;
+	key.chunkX = (int)floorf(centre.x / chunkSize);
+	key.chunkZ = (int)floorf(centre.z / chunkSize);
+	key.texture = texture;
+	key.material = material;
+
+	Group& group = groups[key];
+	unsigned int baseVertex = group.vertices.size() / 8;
+
+	for (size_t i = 0; i < numOfVertices; i += 8)
+	{
+		glm::vec3 position = glm::vec3(model * glm::vec4(vertices[i], vertices[i + 1], vertices[i + 2], 1.0f));
+		glm::vec3 normal = normalMatrix * glm::vec3(vertices[i + 5], vertices[i + 6], vertices[i + 7]);
+
+		GLfloat length = glm::length(normal);
+		if (length > 0.0f)
+		{
+			normal /= length;
+		}
+
+		group.vertices.insert(group.vertices.end(), { position.x, position.y, position.z,
+			vertices[i + 3], vertices[i + 4],
+			normal.x, normal.y, normal.z });
+	}
+
+	for (size_t i = 0; i < numOfIndices; i++)
+	{
+		group.indices.push_back(baseVertex + indices[i]);
+	}
+}
+
+void StaticBatch::Build()
+{
+	auto it = groups.begin();
+	while (it != groups.end())
+	{
+		// the groups are ordered by texture and material, so each run shares a mesh
+		Texture* texture = it->first.texture;
+		Material* material = it->first.material;
+		size_t firstDraw = draws.size();
+
+		std::vector<GLfloat> vertices;
+		std::vector<unsigned int> indices;
+
+		for (; it != groups.end() && it->first.texture == texture && it->first.material == material; ++it)
+		{
+			Group& group = it->second;
+			if (group.indices.empty())
+			{
+				continue;
+			}
+
+			Draw draw;
+			draw.mesh = nullptr;
+			draw.texture = texture;
+			draw.material = material;
+			draw.indexOffset = indices.size();
+			draw.indexCount = group.indices.size();
+
+			for (size_t i = 0; i < group.vertices.size(); i += 8)
+			{
+				draw.bounds.Expand(glm::vec3(group.vertices[i], group.vertices[i + 1], group.vertices[i + 2]));
+			}
+
+			unsigned int baseVertex = vertices.size() / 8;
+			vertices.insert(vertices.end(), group.vertices.begin(), group.vertices.end());
+			for (size_t i = 0; i < group.indices.size(); i++)
+			{
+				indices.push_back(baseVertex + group.indices[i]);
+			}
+
+			draws.push_back(draw);
+		}
+
+		if (indices.empty())
+		{
+			continue;
+		}
+
+		Mesh* mesh = new Mesh();
+		mesh->CreateMesh(&vertices[0], &indices[0], vertices.size(), indices.size());
+		meshes.push_back(mesh);
+
+		for (size_t i = firstDraw; i < draws.size(); i++)
+		{
+			draws[i].mesh = mesh;
+		}
+	}
+
+	// the source geometry lives on the GPU now
+	groups.clear();
+
+	printf("Static batch: %u draws in %u meshes\n", (GLuint)draws.size(), (GLuint)meshes.size());
+}
+
+void StaticBatch::Clear()
+{
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		delete meshes[i];
+	}
+
+	meshes.clear();
+	draws.clear();
+	groups.clear();
+}
+
+StaticBatch::~StaticBatch()
+{
+	Clear();
+}
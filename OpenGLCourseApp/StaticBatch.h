@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <map>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "Texture.h"
+#include "Material.h"
+
+// Objects that never move, baked into world space and merged per texture and material within
+// each chunk of a grid on the ground plane. All chunks sharing a texture and material live in
+// one mesh as separate index ranges, so each chunk can be culled on its own and the visible
+// ones drawn together with one indirect call.
+class StaticBatch
+{
+public:
+	struct Draw {
+		Mesh* mesh;
+		Texture* texture;
+		Material* material;
+
+		GLuint indexOffset;
+		GLsizei indexCount;
+		BoundingBox bounds;
+	};
+
+	StaticBatch();
+	StaticBatch(GLfloat chunkSize);
+
+	// vertices are 8 floats each: position, uv, normal
+	void Add(const GLfloat* vertices, unsigned int numOfVertices, const unsigned int* indices, unsigned int numOfIndices,
+			glm::mat4 model, Texture* texture, Material* material);
+	void Build();
+	void Clear();
+
+	const std::vector<Draw>& GetDraws() { return draws; }
+
+	~StaticBatch();
+
+private:
+	struct Group {
+		std::vector<GLfloat> vertices;
+		std::vector<unsigned int> indices;
+	};
+
+	struct GroupKey {
+		int chunkX, chunkZ;
+		Texture* texture;
+		Material* material;
+
+		bool operator<(const GroupKey& other) const;
+	};
+
+	GLfloat chunkSize;
+
+	std::map<GroupKey, Group> groups;
+	std::vector<Draw> draws;
+	std::vector<Mesh*> meshes;
+};
+
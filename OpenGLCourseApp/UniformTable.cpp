@@ -0,0 +1,199 @@
+#include "pch.h"
+#include "UniformTable.h"
+
+#include <algorithm>
+#include <string>
+#include <string.h>
+#include <stdio.h>
+
+
+UniformTable::UniformTable()
+{
+	entryCount = 0;
+	maxLocation = -1;
+}
+
+void UniformTable::Build(GLuint program)
+{
+	Clear();
+
+	// kept at most half full; plain arrays add an entry per element, so it may still grow
+	GLint activeUniforms = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &activeUniforms);
+
+	GLuint capacity = 16;
+	while (capacity < (GLuint)activeUniforms * 2)
+	{
+		capacity *= 2;
+	}
+	entries.assign(capacity, Entry{ 0, -1, 0 });
+	names.push_back('\0');
+
+	if (GLEW_VERSION_4_3 || GLEW_ARB_program_interface_query)
+	{
+		GLint resourceCount = 0, maxLength = 0;
+		glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &resourceCount);
+		glGetProgramInterfaceiv(program, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxLength);
+
+		std::vector<char> name(maxLength + 1);
+		const GLenum properties[3] = { GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+
+		for (GLint i = 0; i < resourceCount; i++)
+		{
+			GLint values[3] = { -1, 0, -1 };
+			glGetProgramResourceiv(program, GL_UNIFORM, i, 3, properties, 3, NULL, values);
+
+			// members of uniform blocks have no location
+			if (values[2] != -1)
+			{
+				continue;
+			}
+
+			glGetProgramResourceName(program, GL_UNIFORM, i, maxLength, NULL, name.data());
+			AddArray(program, name.data(), values[0], values[1]);
+		}
+	}
+	else {
+		GLint maxLength = 0;
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::vector<char> name(maxLength + 1);
+
+		for (GLint i = 0; i < activeUniforms; i++)
+		{
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(program, i, maxLength, NULL, &size, &type, name.data());
+			AddArray(program, name.data(), glGetUniformLocation(program, name.data()), size);
+		}
+	}
+
+	std::sort(arrayHashes.begin(), arrayHashes.end());
+	arrayHashes.erase(std::unique(arrayHashes.begin(), arrayHashes.end()), arrayHashes.end());
+}
+
+void UniformTable::Clear()
+{
+	entries.clear();
+	entryCount = 0;
+	maxLocation = -1;
+	names.clear();
+	arrayHashes.clear();
+}
+
+GLint UniformTable::Find(const char* name) const
+{
+	if (entries.empty())
+	{
+		return -1;
+	}
+
+	GLuint hash = Hash(name, strlen(name));
+	GLuint mask = (GLuint)entries.size() - 1;
+
+	for (GLuint slot = hash & mask; entries[slot].nameOffset; slot = (slot + 1) & mask)
+	{
+		if (entries[slot].hash == hash && strcmp(&names[entries[slot].nameOffset], name) == 0)
+		{
+			return entries[slot].location;
+		}
+	}
+
+	return -1;
+}
+
+bool UniformTable::HasArray(const char* name) const
+{
+	return std::binary_search(arrayHashes.begin(), arrayHashes.end(), Hash(name, strlen(name)));
+}
+
+void UniformTable::Add(const char* name, GLint location)
+{
+	// more array elements than expected from the uniform count; grow and rehash
+	if ((entryCount + 1) * 2 > entries.size())
+	{
+		std::vector<Entry> old;
+		old.swap(entries);
+		entries.assign(old.size() * 2, Entry{ 0, -1, 0 });
+
+		GLuint mask = (GLuint)entries.size() - 1;
+		for (size_t i = 0; i < old.size(); i++)
+		{
+			if (old[i].nameOffset)
+			{
+				GLuint slot = old[i].hash & mask;
+				while (entries[slot].nameOffset)
+				{
+					slot = (slot + 1) & mask;
+				}
+				entries[slot] = old[i];
+			}
+		}
+	}
+
+	Entry entry;
+	entry.hash = Hash(name, strlen(name));
+	entry.location = location;
+	entry.nameOffset = (GLuint)names.size();
+	names.insert(names.end(), name, name + strlen(name) + 1);
+
+	GLuint mask = (GLuint)entries.size() - 1;
+	GLuint slot = entry.hash & mask;
+	while (entries[slot].nameOffset)
+	{
+		slot = (slot + 1) & mask;
+	}
+	entries[slot] = entry;
+	entryCount++;
+
+	if (location > maxLocation)
+	{
+		maxLocation = location;
+	}
+
+	// "pointLights[1].position" makes "pointLights" known as an array
+	const char* bracket = strchr(name, '[');
+	if (bracket)
+	{
+		arrayHashes.push_back(Hash(name, bracket - name));
+	}
+}
+
+void UniformTable::AddArray(GLuint program, const char* name, GLint location, GLint size)
+{
+	Add(name, location);
+
+	// arrays of plain types are reported once, as "name[0]" with their size
+	size_t length = strlen(name);
+	if (size <= 1 || length < 3 || strcmp(name + length - 3, "[0]") != 0)
+	{
+		return;
+	}
+
+	// element locations are only promised to be consecutive with explicit locations, so ask
+	std::string base(name, length - 3);
+	for (GLint i = 1; i < size; i++)
+	{
+		char locBuff[100] = { '\0' };
+
+		snprintf(locBuff, sizeof(locBuff), "%s[%d]", base.c_str(), i);
+		Add(locBuff, glGetUniformLocation(program, locBuff));
+	}
+}
+
+GLuint UniformTable::Hash(const char* name, size_t length)
+{
+	// FNV-1a
+	GLuint hash = 2166136261u;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+UniformTable::~UniformTable()
+{
+}
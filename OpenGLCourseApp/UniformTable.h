@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+// Locations of a program's active uniforms, read back once after linking and kept in an open
+// addressing table hashed by name. Array elements get an entry each ("lights[2]"), and the
+// names of arrays are kept too, so whole groups of lookups can be skipped for programs without them.
+// Storage blocks in this project use explicit bindings, so there is nothing to reflect for those.
+class UniformTable
+{
+public:
+	UniformTable();
+
+	void Build(GLuint program);
+	void Clear();
+
+	// -1 when the program has no such active uniform, the same as glGetUniformLocation
+	GLint Find(const char* name) const;
+
+	// whether any element of this array is active, by the name without brackets
+	bool HasArray(const char* name) const;
+
+	GLuint GetUniformCount() const { return entryCount; }
+	GLint GetMaxLocation() const { return maxLocation; }
+
+	~UniformTable();
+
+private:
+	struct Entry
+	{
+		GLuint hash;
+		GLint location;
+		GLuint nameOffset;	// into names, 0 marks an empty slot
+	};
+
+	std::vector<Entry> entries;
+	GLuint entryCount;
+	GLint maxLocation;
+	std::vector<char> names;
+	std::vector<GLuint> arrayHashes;	// sorted
+
+	void Add(const char* name, GLint location);
+	void AddArray(GLuint program, const char* name, GLint location, GLint size);
+
+	static GLuint Hash(const char* name, size_t length);
+};
@@ -0,0 +1,152 @@
+#include "pch.h"
+#include "VarianceShadowMap.h"
+
+#include "Shader.h"
+
+VarianceShadowMap::VarianceShadowMap() : ShadowMap()
+{
+	depthBuffer = 0;
+	blurFBO = 0;
+	blurTexture = 0;
+	emptyVAO = 0;
+	blurShader = nullptr;
+	uniformBlurDirection = 0;
+
+	filter = SHADOW_FILTER_VSM;
+}
+
+bool VarianceShadowMap::Init(GLuint width, GLuint height)
+{
+	shadowWidth = width; shadowHeight = height;
+
+	// moments target, mipmapped so distant receivers get a pre-filtered value
+	glGenTextures(1, &shadowMap);
+	glBindTexture(GL_TEXTURE_2D, shadowMap);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, shadowWidth, shadowHeight, 0, GL_RG, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	float bColour[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, bColour);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	glGenTextures(1, &blurTexture);
+	glBindTexture(GL_TEXTURE_2D, blurTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, shadowWidth, shadowHeight, 0, GL_RG, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, shadowWidth, shadowHeight);
+
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, shadowMap, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Framebuffer Error: %i\n", status);
+		return false;
+	}
+
+	glGenFramebuffers(1, &blurFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, blurFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurTexture, 0);
+
+	status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Framebuffer Error: %i\n", status);
+		return false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// the blur draws a single full screen triangle generated from gl_VertexID
+	glGenVertexArrays(1, &emptyVAO);
+
+	blurShader = new Shader();
+	blurShader->CreateFromFiles("Shaders/shadow_blur.vert", "Shaders/shadow_blur.frag");
+	uniformBlurDirection = blurShader->GetBlurDirectionLocation();
+
+	return true;
+}
+
+void VarianceShadowMap::Write()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+	// empty texels must read as "fully lit": both moments at the far plane
+	GLfloat farMoments[] = { 1.0f, 1.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, farMoments);
+}
+
+void VarianceShadowMap::BlurPass(GLuint targetFBO, GLuint sourceTexture, GLfloat xStep, GLfloat yStep)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, sourceTexture);
+	Shader::Uniform2f(uniformBlurDirection, xStep, yStep);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void VarianceShadowMap::Resolve()
+{
+	Shader* previousShader = Shader::GetBoundShader();
+
+	glDisable(GL_DEPTH_TEST);
+	blurShader->UseShader();
+	glBindVertexArray(emptyVAO);
+
+	BlurPass(blurFBO, shadowMap, 1.0f / shadowWidth, 0.0f);
+	BlurPass(FBO, blurTexture, 0.0f, 1.0f / shadowHeight);
+
+	glBindTexture(GL_TEXTURE_2D, shadowMap);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+	Shader::Rebind(previousShader);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VarianceShadowMap::Read(GLenum textureUnit)
+{
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_2D, shadowMap);
+}
+
+VarianceShadowMap::~VarianceShadowMap()
+{
+	if (blurFBO)
+	{
+		glDeleteFramebuffers(1, &blurFBO);
+	}
+
+	if (blurTexture)
+	{
+		glDeleteTextures(1, &blurTexture);
+	}
+
+	if (depthBuffer)
+	{
+		glDeleteRenderbuffers(1, &depthBuffer);
+	}
+
+	if (emptyVAO)
+	{
+		glDeleteVertexArrays(1, &emptyVAO);
+	}
+
+	delete blurShader;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "ShadowMap.h"
+
+class Shader;
+
+// 2D shadow map storing depth and depth squared. After rendering, the moments are
+// blurred with a separable filter and mipmapped so the lighting shader needs one fetch.
+class VarianceShadowMap :
+	public ShadowMap
+{
+public:
+	VarianceShadowMap();
+
+	bool Init(GLuint width, GLuint height);
+
+	void Write();
+
+	void Resolve();
+
+	void Read(GLenum textureUnit);
+
+	~VarianceShadowMap();
+
+private:
+	GLuint depthBuffer;
+	GLuint blurFBO, blurTexture;
+	GLuint emptyVAO;
+
+	Shader* blurShader;
+	GLuint uniformBlurDirection;
+
+	void BlurPass(GLuint targetFBO, GLuint sourceTexture, GLfloat xStep, GLfloat yStep);
+};
+